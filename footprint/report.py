@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Build the footprint reference sketches (see platformio.ini) and report the
+flash and RAM used by each, relative to its baseline sketch (given by the
+environment's 'custom_baseline' option, 'baseline' by default).
+
+Usage: ./report.py [ENV ...]
+
+Requires PlatformIO ('pio') to be installed.
+"""
+
+import configparser
+import os
+import re
+import subprocess
+import sys
+
+FOOTPRINT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+DEFAULT_BASELINE = "baseline"
+
+RAM_RE = re.compile(r"^RAM:.*\(used (\d+) bytes", re.MULTILINE)
+FLASH_RE = re.compile(r"^Flash:.*\(used (\d+) bytes", re.MULTILINE)
+
+
+def read_config():
+    config = configparser.ConfigParser()
+    config.read(os.path.join(FOOTPRINT_DIR, "platformio.ini"))
+    return config
+
+
+def get_envs(config):
+    return [section[len("env:"):]
+            for section in config.sections()
+            if section.startswith("env:")]
+
+
+def get_baseline(config, env):
+    """Get the baseline environment for an environment, following 'extends'."""
+    sections = ["env:" + env]
+    while sections:
+        section = sections.pop(0)
+        if not config.has_section(section):
+            continue
+        if config.has_option(section, "custom_baseline"):
+            return config.get(section, "custom_baseline")
+        if config.has_option(section, "extends"):
+            sections.extend(s.strip()
+                            for s in config.get(section, "extends").split(","))
+    return DEFAULT_BASELINE
+
+
+def build(env):
+    """
+    Build an environment, returning (flash, ram) in bytes or None (after
+    printing the build output) if the build failed.
+    """
+    result = subprocess.run(["pio", "run", "-d", FOOTPRINT_DIR, "-e", env],
+                            stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout)
+        sys.stderr.write("Build of '{}' failed\n".format(env))
+        return None
+
+    flash = FLASH_RE.search(result.stdout)
+    ram = RAM_RE.search(result.stdout)
+    if not flash or not ram:
+        raise Exception("Couldn't find sizes for '{}'".format(env))
+
+    return (int(flash.group(1)), int(ram.group(1)))
+
+
+def main(argv):
+    config = read_config()
+    envs = argv[1:] or get_envs(config)
+    baselines = {env: get_baseline(config, env) for env in envs}
+    for baseline in baselines.values():
+        if baseline not in envs:
+            envs.insert(0, baseline)
+
+    sizes = {env: build(env) for env in envs}
+
+    print("| Sketch | Baseline | Flash | RAM | Flash (+baseline) | RAM (+baseline) |")
+    print("|--------|----------|------:|----:|------------------:|----------------:|")
+    for env in envs:
+        baseline = baselines.get(env, get_baseline(config, env))
+        if sizes[env] is None:
+            print("| {} | {} | failed | failed | | |".format(env, baseline))
+        elif sizes[baseline] is None:
+            print("| {} | {} | {} | {} | | |".format(env, baseline, *sizes[env]))
+        else:
+            base_flash, base_ram = sizes[baseline]
+            flash, ram = sizes[env]
+            print("| {} | {} | {} | {} | {:+d} | {:+d} |".format(
+                env, baseline, flash, ram, flash - base_flash, ram - base_ram))
+
+    # Report (but don't stop at) failed builds
+    return 1 if None in sizes.values() else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
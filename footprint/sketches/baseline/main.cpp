@@ -0,0 +1,22 @@
+/**
+ * Footprint baseline: a bare PubSubClient sketch without Qth. Other sketches
+ * are reported relative to this one.
+ */
+
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+
+WiFiClient wifiClient;
+PubSubClient mqtt("qth", 1883, wifiClient);
+
+void setup() {
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  if (!mqtt.connected()) {
+    mqtt.connect("footprint");
+  }
+  mqtt.loop();
+  mqtt.publish("footprint/property", "1", true);
+}
@@ -0,0 +1,23 @@
+/**
+ * Footprint: core using a BufferedClient.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::BufferedClient bufferedClient(wifiClient);
+Qth::QthClient qth("qth", bufferedClient, "footprint");
+
+Qth::Property property("footprint/property", "A property.");
+
+void setup() {
+  qth.registerProperty(&property);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  qth.setProperty(&property, "1");
+}
@@ -0,0 +1,27 @@
+/**
+ * Footprint: QthClient with plain Property and Event objects only.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+
+void onEvent(const char *topic, const char *json) {}
+
+Qth::Property property("footprint/property", "A property.");
+Qth::Event event("footprint/event", onEvent, "An event.");
+
+void setup() {
+  qth.registerProperty(&property);
+  qth.registerEvent(&event);
+  qth.watchEvent(&event);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  qth.setProperty(&property, "1");
+}
@@ -0,0 +1,26 @@
+/**
+ * Footprint: core plus an EEPROMProperty.
+ */
+
+#include <ESP8266WiFi.h>
+#include <EEPROM.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+
+Qth::EEPROMProperty *property;
+
+void setup() {
+  EEPROM.begin(64);
+  property = new Qth::EEPROMProperty("footprint/property", 64, 0, "A property.");
+  qth.registerProperty(property);
+  qth.watchProperty(property);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  digitalWrite(LED_BUILTIN, atoi(property->get()));
+}
@@ -0,0 +1,26 @@
+/**
+ * Footprint: core plus a PersistentProperty stored in a LittleFS file.
+ */
+
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+
+Qth::FileStorage storage(LittleFS, "/qth.bin", 64);
+Qth::PersistentProperty property("footprint/property", storage, 64, 0, "A property.");
+
+void setup() {
+  LittleFS.begin();
+  qth.registerProperty(&property);
+  qth.watchProperty(&property);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  digitalWrite(LED_BUILTIN, atoi(property.get()));
+}
@@ -0,0 +1,26 @@
+/**
+ * Footprint: core using an InboundQueue.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+Qth::InboundQueue inboundQueue(4, 64);
+
+void onEvent(const char *topic, const char *json) {}
+
+Qth::Event event("footprint/event", onEvent, "An event.");
+
+void setup() {
+  qth.setInboundQueue(&inboundQueue);
+  qth.registerEvent(&event);
+  qth.watchEvent(&event);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+}
@@ -0,0 +1,26 @@
+/**
+ * Footprint: core using a PoolAllocator.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include "Qth.h"
+
+static char arena[2048];
+Qth::PoolAllocator pool(arena, sizeof(arena));
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+
+Qth::Property property("footprint/property", "A property.");
+
+void setup() {
+  Qth::setAllocator(&pool);
+  qth.registerProperty(&property);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  qth.setProperty(&property, "1");
+}
@@ -0,0 +1,28 @@
+/**
+ * Footprint: core plus deep-sleep session resumption using RTC memory.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+
+Qth::RTCStorage storage(0, 16);
+Qth::Property property("footprint/property", "A property.");
+
+void setup() {
+  qth.setSessionStorage(&storage);
+  qth.registerProperty(&property);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  if (qth.connected()) {
+    qth.setProperty(&property, "1");
+    qth.disconnect();
+    ESP.deepSleep(60e6);
+  }
+}
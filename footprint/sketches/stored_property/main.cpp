@@ -0,0 +1,23 @@
+/**
+ * Footprint: core plus a StoredProperty.
+ */
+
+#include <ESP8266WiFi.h>
+
+#include "Qth.h"
+
+WiFiClient wifiClient;
+Qth::QthClient qth("qth", wifiClient, "footprint");
+
+Qth::StoredProperty property("footprint/property", "0", "A property.");
+
+void setup() {
+  qth.registerProperty(&property);
+  qth.watchProperty(&property);
+  WiFi.begin("ssid", "password");
+}
+
+void loop() {
+  qth.loop();
+  digitalWrite(LED_BUILTIN, atoi(property.get()));
+}
@@ -0,0 +1,24 @@
+/**
+ * Footprint baseline (AVR): a bare PubSubClient sketch without Qth. Other uno_*
+ * sketches are reported relative to this one.
+ */
+
+#include <Ethernet.h>
+#include <PubSubClient.h>
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+
+EthernetClient ethClient;
+PubSubClient mqtt("qth", 1883, ethClient);
+
+void setup() {
+  Ethernet.begin(mac);
+}
+
+void loop() {
+  if (!mqtt.connected()) {
+    mqtt.connect("footprint");
+  }
+  mqtt.loop();
+  mqtt.publish("footprint/property", "1", true);
+}
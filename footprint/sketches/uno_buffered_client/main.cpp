@@ -0,0 +1,25 @@
+/**
+ * Footprint (AVR): core using a BufferedClient.
+ */
+
+#include <Ethernet.h>
+
+#include "Qth.h"
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+
+EthernetClient ethClient;
+Qth::BufferedClient bufferedClient(ethClient);
+Qth::QthClient qth("qth", bufferedClient, "footprint");
+
+Qth::Property property("footprint/property", "A property.");
+
+void setup() {
+  qth.registerProperty(&property);
+  Ethernet.begin(mac);
+}
+
+void loop() {
+  qth.loop();
+  qth.setProperty(&property, "1");
+}
@@ -0,0 +1,29 @@
+/**
+ * Footprint (AVR): QthClient with plain Property and Event objects only.
+ */
+
+#include <Ethernet.h>
+
+#include "Qth.h"
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+
+EthernetClient ethClient;
+Qth::QthClient qth("qth", ethClient, "footprint");
+
+void onEvent(const char *topic, const char *json) {}
+
+Qth::Property property("footprint/property", "A property.");
+Qth::Event event("footprint/event", onEvent, "An event.");
+
+void setup() {
+  qth.registerProperty(&property);
+  qth.registerEvent(&event);
+  qth.watchEvent(&event);
+  Ethernet.begin(mac);
+}
+
+void loop() {
+  qth.loop();
+  qth.setProperty(&property, "1");
+}
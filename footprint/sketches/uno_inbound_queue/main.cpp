@@ -0,0 +1,28 @@
+/**
+ * Footprint (AVR): core using an InboundQueue.
+ */
+
+#include <Ethernet.h>
+
+#include "Qth.h"
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+
+EthernetClient ethClient;
+Qth::QthClient qth("qth", ethClient, "footprint");
+Qth::InboundQueue inboundQueue(2, 32);
+
+void onEvent(const char *topic, const char *json) {}
+
+Qth::Event event("footprint/event", onEvent, "An event.");
+
+void setup() {
+  qth.setInboundQueue(&inboundQueue);
+  qth.registerEvent(&event);
+  qth.watchEvent(&event);
+  Ethernet.begin(mac);
+}
+
+void loop() {
+  qth.loop();
+}
@@ -0,0 +1,28 @@
+/**
+ * Footprint (AVR): core using a PoolAllocator.
+ */
+
+#include <Ethernet.h>
+
+#include "Qth.h"
+
+static char arena[256];
+Qth::PoolAllocator pool(arena, sizeof(arena));
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+
+EthernetClient ethClient;
+Qth::QthClient qth("qth", ethClient, "footprint");
+
+Qth::Property property("footprint/property", "A property.");
+
+void setup() {
+  Qth::setAllocator(&pool);
+  qth.registerProperty(&property);
+  Ethernet.begin(mac);
+}
+
+void loop() {
+  qth.loop();
+  qth.setProperty(&property, "1");
+}
@@ -0,0 +1,25 @@
+/**
+ * Footprint (AVR): core plus a StoredProperty.
+ */
+
+#include <Ethernet.h>
+
+#include "Qth.h"
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+
+EthernetClient ethClient;
+Qth::QthClient qth("qth", ethClient, "footprint");
+
+Qth::StoredProperty property("footprint/property", "0", "A property.");
+
+void setup() {
+  qth.registerProperty(&property);
+  qth.watchProperty(&property);
+  Ethernet.begin(mac);
+}
+
+void loop() {
+  qth.loop();
+  digitalWrite(LED_BUILTIN, atoi(property.get()));
+}
@@ -1,209 +1,354 @@
-#include <EEPROM.h>
-
 #include "Qth.h"
 
-void Qth::StoredProperty::_set(const char *newValue) {
-	char *oldValue = value;
-	
-	if (newValue) {
-		size_t len = strlen(newValue);
-		value = (char *)malloc(len + 1);
-		memcpy(value, newValue, len + 1);
-	} else {
-		value = NULL;
-	}
-	
-	// NB: Free afterwards incase someone sets the property to its current
-	// value!
-	if (oldValue) {
-		free(oldValue);
-	}
-}
-
-void Qth::StoredProperty::set(const char *newValue) {
-	_set(newValue);
-	if (qth && value) {
-		qth->setProperty(this, value);
-	}
-	Property::call(name, value);
-}
-
-const char *Qth::StoredProperty::get() {
-	return value;
-}
+Qth::QthClient *Qth::QthClient::qth = NULL;
 
-void Qth::StoredProperty::call(const char *topic, const char *json) {
-	_set(json);
-	Property::call(topic, json);
-}
+void (*Qth::QthClient::commitStorage)() = NULL;
 
+#ifdef QTH_THREADSAFE
+void (*Qth::QthClient::loadPersistentProperties)() = NULL;
+#endif
 
-void Qth::StoredProperty::onConnect() {
-	set(value);
-	Property::onConnect();
-};
+// Marks a SessionState saved by a clean disconnect()
+static const uint32_t SESSION_MAGIC = 0x51746853ul;
 
-Qth::EEPROMProperty::EEPROMProperty(const char *name,
-                                    size_t maxLength,
-                                    size_t eepromAddress,
-                                    const char *description,
-                                    bool oneToMany,
-                                    const char *onUnregisterJson,
-                                    callback_t callback) :
-	StoredProperty(name, NULL, description, oneToMany, onUnregisterJson, callback),
-	maxLength(maxLength),
-	eepromAddress(eepromAddress)
-{
-	// Read the initial value from flash
-	char *flash_stored_codes = (char *)malloc(maxLength);
-	for (size_t i = 0; i < maxLength-1; i++) {
-		flash_stored_codes[i] = EEPROM.read(eepromAddress + i);
-	}
-	flash_stored_codes[maxLength-1] = '\0';
-	set(flash_stored_codes);
-	free(flash_stored_codes);
+// 32-bit FNV-1a hash of a null-terminated string (including the terminator)
+static uint32_t hashString(uint32_t hash, const char *str) {
+	do {
+		hash ^= (uint8_t)*str;
+		hash *= 16777619ul;
+	} while (*(str++));
+	return hash;
 }
 
-Qth::EEPROMProperty::~EEPROMProperty() {
-}
+static const uint32_t HASH_INIT = 2166136261ul;
 
-void Qth::EEPROMProperty::_set(const char *newValue) {
-	// Persist into EEPROM (NB: can't represent NULL value in EEPROM so just
-	// ignore this).
-	if (newValue) {
-		size_t i = 0;
-		do {
-			EEPROM.write(eepromAddress + i, newValue[i]);
-		} while (newValue[i++] != '\0' && i < maxLength);
-		EEPROM.commit();
-		
-		// Store the value
-		StoredProperty::_set(newValue);
+// Append a string to buf at offset len, returning the new length. If buf is
+// NULL, just computes the length.
+static size_t append(char *buf, size_t len, const char *str) {
+	size_t strLen = strlen(str);
+	if (buf) {
+		memcpy(buf + len, str, strLen);
 	}
+	return len + strLen;
 }
 
-Qth::QthClient *Qth::QthClient::qth = NULL;
-
 void Qth::QthClient::loop() {
-	// Reconnect if required
+#ifdef QTH_THREADSAFE
+	if (!loopTaskKnown.load(std::memory_order_relaxed)) {
+		loopTask = Qth::currentTask();
+		loopTaskKnown.store(true, std::memory_order_release);
+	}
+	
+	// Stored values are only loaded by this task since other tasks may be
+	// reading them (see PersistentProperty)
+	if (loadPersistentProperties) {
+		loadPersistentProperties();
+	}
+#endif
+	
+	// Reconnect if required (NB: the first attempt is made immediately to
+	// avoid delaying startup, e.g. after waking from deep sleep)
 	if (!mqtt.connected()) {
 		unsigned long now = millis();
-		if (now - lastReconnect > Qth::RECONNECT_DELAY) {
+		if (firstConnectAttempt || now - lastReconnect > Qth::RECONNECT_DELAY) {
+			firstConnectAttempt = false;
 			lastReconnect = now;
 			
-			size_t topicLen = strlen("meta/clients/") + strlen(clientId) + 1;
-			char lwtTopic[topicLen];
-			sprintf(lwtTopic, "meta/clients/%s", clientId);
+			char *lwtTopic = buildClientTopic();
 			
 			int lwtQoS = 2;
 			bool lwtRetain = true;
 			const char lwtMessage[] = "";
 			
-			if (mqtt.connect(clientId, lwtTopic, lwtQoS, lwtRetain, lwtMessage)) {
+			// Persistent sessions are only useful with a session storage. A
+			// previous session with different subscriptions is discarded since
+			// the stale subscriptions are unknown and so can't be unsubscribed.
+			cleanSession = true;
+			if (sessionStorage) {
+				SessionState state;
+				sessionStorage->read(sessionAddress, (char *)&state, sizeof(state));
+				cleanSession = state.magic == SESSION_MAGIC &&
+				               state.subscriptionHash != subscriptionHash();
+			}
+			
+			if (lwtTopic &&
+			    mqtt.connect(clientId, NULL, NULL,
+			                 lwtTopic, lwtQoS, lwtRetain, lwtMessage,
+			                 cleanSession)) {
 				onConnect();
 			}
+			
+			Qth::deallocate(lwtTopic);
 		}
 	}
 	
 	mqtt.loop();
+
+#ifdef QTH_THREADSAFE
+	// Carry out actions queued by other tasks
+	if (publishQueue) {
+		Qth::PublishQueue::Action action;
+		const char *payload;
+		Qth::Entity *entity;
+		while ((entity = publishQueue->front(&action, &payload))) {
+			switch (action) {
+				case Qth::PublishQueue::SET_PROPERTY:
+					setProperty((Qth::Property *)entity, payload);
+					break;
+				case Qth::PublishQueue::SEND_EVENT:
+					sendEvent((Qth::Event *)entity, payload);
+					break;
+				case Qth::PublishQueue::SET_STORED_PROPERTY:
+					((Qth::StoredProperty *)entity)->set(payload);
+					break;
+			}
+			publishQueue->pop();
+		}
+	}
+#endif
+	
+	// Dispatch queued messages
+	if (inboundQueue) {
+		for (size_t i = 0; i < inboundQueue->getBudget(); i++) {
+			const char *payload;
+			Qth::Entity *entity = inboundQueue->pop(&payload);
+			if (!entity) {
+				break;
+			}
+			deliver(entity, entity->name, payload);
+		}
+	}
+	
+	// Stop waiting for values which haven't arrived after the sync timeout
+	if (!synced && syncTimeout && mqtt.connected() &&
+	    millis() - syncStart >= syncTimeout) {
+		endSync(true);
+	}
+	
+	// Persist any values changed during this cycle
+	if (commitStorage) {
+		commitStorage();
+	}
+	
+	// Send everything written during this cycle
+	if (bufferedClient) {
+		bufferedClient->flushWrites();
+	}
 }
 
 bool Qth::QthClient::connected() {
 	return mqtt.connected();
 }
 
+void Qth::QthClient::disconnect() {
+	bool wasConnected = mqtt.connected();
+	
+	// Record what the server already knows about this client for when the
+	// session is resumed. (A clean session ends here so can't be resumed: the
+	// next connection will start a new persistent session.)
+	if (wasConnected && sessionStorage && !cleanSession) {
+		char *registration = buildRegistration();
+		if (registration) {
+			SessionState state;
+			state.magic = SESSION_MAGIC;
+			state.registrationHash = hashString(HASH_INIT, registration);
+			state.subscriptionHash = subscriptionHash();
+			
+			sessionStorage->write(sessionAddress, (const char *)&state, sizeof(state));
+		}
+		Qth::deallocate(registration);
+	}
+	
+	// Persist the session state along with any values changed since the last
+	// loop() (e.g. before entering deep sleep), even if the connection has
+	// already been lost
+	if (commitStorage) {
+		commitStorage();
+	}
+	
+	if (wasConnected) {
+		mqtt.disconnect();
+	}
+}
+
 void Qth::QthClient::onMessage(const char *topic, const char *payload, unsigned int length) {
+	// A null-terminated copy of the payload (made when first needed)
+	char *payloadNullTerminated = NULL;
+	
 	Qth::Entity *subscription = subscriptions;
 	while (subscription) {
 		if (strcmp(subscription->name, topic) == 0) {
-			// Make a null-terminated copy of the payload on the stack
-			char payloadNullTerminated[length];
-			memcpy(payloadNullTerminated, payload, length);
-			payloadNullTerminated[length] = 0;
-			
-			subscription->call(topic, payloadNullTerminated);
+			if (inboundQueue) {
+				// Dispatch later (during loop)
+				inboundQueue->push(subscription, payload, length);
+			} else {
+				if (!payloadNullTerminated) {
+					payloadNullTerminated = (char *)Qth::allocate(length + 1);
+					if (!payloadNullTerminated) {
+						return;
+					}
+					memcpy(payloadNullTerminated, payload, length);
+					payloadNullTerminated[length] = 0;
+				}
+				
+				deliver(subscription, topic, payloadNullTerminated);
+			}
 		}
 		
 		subscription = subscription->nextSubscription;
 	}
+	
+	Qth::deallocate(payloadNullTerminated);
 }
 
-void Qth::QthClient::sendRegistration() {
-	const char *REG_PRE_TMPL = "{\"description\":\"%s\",\"topics\":{";
-	const char *REG_POST_TMPL = "}}";
-	const char *TOPIC_TMPL = "\"%s\":{\"description\":\"%s\",\"behaviour\":\"%s\"},";
-	const char *TOPIC_ON_UNREGISTER_TMPL = "\"%s\":{\"description\":\"%s\",\"behaviour\":\"%s\",\"on_unregister\":%s},";
-	const char *topic_delete_on_unregister_tmpl = "\"%s\":{\"description\":\"%s\",\"behaviour\":\"%s\",\"delete_on_unregister\":true},";
-	
-	// Work out length of registration string
-	size_t regLen = strlen(REG_PRE_TMPL) - (1 * 2);
-	regLen += strlen(description);
-	Qth::Entity *entity = registrations;
+void Qth::QthClient::deliver(Qth::Entity *entity, const char *topic, const char *json) {
+	bool first = !entity->synced;
+	if (first) {
+		entity->synced = true;
+		unsyncedCount--;
+	}
+	
+	entity->call(topic, json);
+	
+	// Only declare sync once the final value has been handled
+	if (first && unsyncedCount == 0 && !synced) {
+		endSync(false);
+	}
+}
+
+void Qth::QthClient::beginSync(bool waitForValues) {
+	synced = false;
+	syncStart = millis();
+	
+	unsyncedCount = 0;
+	Qth::Entity *entity = subscriptions;
 	while (entity) {
-		if (entity->onUnregisterJson == NULL) {
-			regLen += strlen(TOPIC_TMPL) - (3 * 2);
-		} else if (strlen(entity->onUnregisterJson) == 0) {
-			regLen += strlen(topic_delete_on_unregister_tmpl) - (3 * 2);
-		} else {
-			regLen += strlen(TOPIC_ON_UNREGISTER_TMPL) - (4 * 2);
-			regLen += strlen(entity->onUnregisterJson);
+		entity->synced = !(waitForValues && entity->isProperty());
+		if (!entity->synced) {
+			unsyncedCount++;
 			
+			// Values queued before the (re)connect must not count as received
+			if (inboundQueue) {
+				inboundQueue->remove(entity);
+			}
 		}
-		regLen += strlen(entity->name);
-		regLen += strlen(entity->description);
-		regLen += strlen(entity->behaviour);
-		
-		entity = entity->nextRegistration;
+		entity = entity->nextSubscription;
 	}
-	regLen -= 1; // Drop trailing comma
-	regLen += strlen(REG_POST_TMPL);
-	regLen += 1; // Add null terminator
-	
-	// Generate the registration JSON
-	char *outBuf = (char *)malloc(regLen);
-	char *cursor = outBuf;
-	cursor += sprintf(cursor, REG_PRE_TMPL, description);
+}
+
+void Qth::QthClient::endSync(bool timedOut) {
+	synced = true;
+	if (syncCallback) {
+		syncCallback(timedOut);
+	}
+}
+
+char *Qth::QthClient::buildClientTopic() {
+	size_t len = append(NULL, 0, "meta/clients/");
+	len = append(NULL, len, clientId);
+	char *topic = (char *)Qth::allocate(len + 1);
+	if (topic) {
+		len = append(topic, 0, "meta/clients/");
+		len = append(topic, len, clientId);
+		topic[len] = '\0';
+	}
+	return topic;
+}
+
+size_t Qth::QthClient::writeRegistration(char *buf) {
+	size_t len = 0;
+	len = append(buf, len, "{\"description\":\"");
+	len = append(buf, len, description);
+	len = append(buf, len, "\",\"topics\":{");
 	
-	entity = registrations;
+	Qth::Entity *entity = registrations;
 	while (entity) {
+		len = append(buf, len, "\"");
+		len = append(buf, len, entity->name);
+		len = append(buf, len, "\":{\"description\":\"");
+		len = append(buf, len, entity->description);
+		len = append(buf, len, "\",\"behaviour\":\"");
+		len = append(buf, len, entity->behaviour);
+		len = append(buf, len, "\"");
 		if (entity->onUnregisterJson == NULL) {
-			cursor += sprintf(cursor, TOPIC_TMPL,
-			                  entity->name,
-			                  entity->description,
-			                  entity->behaviour);
+			// Nothing to do on unregister
 		} else if (strlen(entity->onUnregisterJson) == 0) {
-			cursor += sprintf(cursor, topic_delete_on_unregister_tmpl,
-			                  entity->name,
-			                  entity->description,
-			                  entity->behaviour);
+			len = append(buf, len, ",\"delete_on_unregister\":true");
 		} else {
-			cursor += sprintf(cursor, TOPIC_ON_UNREGISTER_TMPL,
-			                  entity->name,
-			                  entity->description,
-			                  entity->behaviour,
-			                  entity->onUnregisterJson);
+			len = append(buf, len, ",\"on_unregister\":");
+			len = append(buf, len, entity->onUnregisterJson);
 		}
+		len = append(buf, len, "}");
 		
 		entity = entity->nextRegistration;
+		if (entity) {
+			len = append(buf, len, ",");
+		}
 	}
-	if (registrations) {
-		// Drop trailing comma
-		cursor--;
-	}
-	
-	cursor += sprintf(cursor, REG_POST_TMPL);
-	
-	size_t topicLen = strlen("meta/clients/") + strlen(clientId) + 1;
-	char topic[topicLen];
-	sprintf(topic, "meta/clients/%s", clientId);
 	
-	mqtt.publish(topic, outBuf, true);
-	
-	free(outBuf);
+	len = append(buf, len, "}}");
+	if (buf) {
+		buf[len] = '\0';
+	}
+	return len;
+}
+
+char *Qth::QthClient::buildRegistration() {
+	// Work out length of registration string then generate it
+	char *outBuf = (char *)Qth::allocate(writeRegistration(NULL) + 1);
+	if (outBuf) {
+		writeRegistration(outBuf);
+	}
+	return outBuf;
+}
+
+uint32_t Qth::QthClient::subscriptionHash() {
+	uint32_t hash = HASH_INIT;
+	Qth::Entity *entity = subscriptions;
+	while (entity) {
+		hash = hashString(hash, entity->name);
+		entity = entity->nextSubscription;
+	}
+	return hash;
+}
+
+void Qth::QthClient::sendRegistration(const char *registration) {
+	char *topic = buildClientTopic();
+	if (topic && registration) {
+		mqtt.publish(topic, registration, true);
+	}
+	Qth::deallocate(topic);
+}
+
+void Qth::QthClient::sendRegistration() {
+	char *outBuf = buildRegistration();
+	sendRegistration(outBuf);
+	Qth::deallocate(outBuf);
 }
 
 void Qth::QthClient::onConnect() {
-	sendRegistration();
+	// Find out if we're resuming a cleanly ended session (in which case the
+	// server already has our registration and subscriptions).
+	SessionState state;
+	bool resumed = false;
+	if (sessionStorage) {
+		sessionStorage->read(sessionAddress, (char *)&state, sizeof(state));
+		resumed = !cleanSession && state.magic == SESSION_MAGIC;
+		
+		// If this session isn't also ended cleanly, don't try to resume it
+		if (state.magic == SESSION_MAGIC) {
+			uint32_t invalid = 0;
+			sessionStorage->write(sessionAddress, (const char *)&invalid, sizeof(invalid));
+			sessionStorage->commit();
+		}
+	}
+	
+	char *registration = buildRegistration();
+	if (registration &&
+	    (!resumed || state.registrationHash != hashString(HASH_INIT, registration))) {
+		sendRegistration(registration);
+	}
+	Qth::deallocate(registration);
 	
 	// Run on-connection logic for all registered values (e.g. to send initial
 	// values or most recent values when reconnecting).
@@ -214,16 +359,28 @@ void Qth::QthClient::onConnect() {
 	}
 	
 	// Set up all existing subscriptions.
-	entity = subscriptions;
-	while (entity) {
-		mqtt.subscribe(entity->name, 1);  // QoS 2 not available
-		entity = entity->nextSubscription;
+	bool resubscribe = !resumed || state.subscriptionHash != subscriptionHash();
+	if (resubscribe) {
+		entity = subscriptions;
+		while (entity) {
+			mqtt.subscribe(entity->name, 1);  // QoS 2 not available
+			entity = entity->nextSubscription;
+		}
 	}
 	
+	// Wait for the server to send the current values of watched properties
+	// (which it only does when subscribing).
+	beginSync(resubscribe);
+	
 	// User callback
 	if (onConnectCallback) {
 		onConnectCallback();
 	}
+	
+	// Nothing to wait for
+	if (unsyncedCount == 0) {
+		endSync(false);
+	}
 }
 
 void Qth::QthClient::registerEntity(Qth::Entity *entity) {
@@ -263,15 +420,27 @@ void Qth::QthClient::watchEntity(Qth::Entity *entity) {
 	
 	entity->qth = this;
 	
+	// Wait for the current value of a newly watched property
+	entity->synced = !entity->isProperty();
+	if (!entity->synced) {
+		unsyncedCount++;
+		if (synced) {
+			synced = false;
+			syncStart = millis();
+		}
+	}
+	
 	mqtt.subscribe(entity->name, 1);  // QoS 2 not available
 }
 
 void Qth::QthClient::unwatchEntity(Qth::Entity *entity) {
 	// Remove from list
+	bool found = false;
 	Qth::Entity **subscriptionPtr = &subscriptions;
 	while (*subscriptionPtr) {
 		if ((*subscriptionPtr) == entity) {
 			*subscriptionPtr = entity->nextSubscription;
+			found = true;
 		}
 		if (*subscriptionPtr) {
 			subscriptionPtr = &((*subscriptionPtr)->nextSubscription);
@@ -279,12 +448,53 @@ void Qth::QthClient::unwatchEntity(Qth::Entity *entity) {
 	}
 	
 	mqtt.unsubscribe(entity->name);
+	
+	// Stop waiting for the value of this property
+	if (found && !entity->synced) {
+		entity->synced = true;
+		unsyncedCount--;
+		if (unsyncedCount == 0 && !synced && mqtt.connected()) {
+			endSync(false);
+		}
+	}
+	
+	// Don't dispatch messages received before unwatching
+	if (inboundQueue) {
+		inboundQueue->remove(entity);
+	}
 }
 
+#ifdef QTH_THREADSAFE
+bool Qth::QthClient::defer(Qth::Entity *entity,
+                           Qth::PublishQueue::Action action,
+                           const char *json) {
+	if (!publishQueue ||
+	    !loopTaskKnown.load(std::memory_order_acquire) ||
+	    Qth::currentTask() == loopTask) {
+		return false;
+	}
+	
+	// NB: If the queue is full the action is dropped (see
+	// PublishQueue::getOverflows()).
+	publishQueue->push(entity, action, json);
+	return true;
+}
+#endif
+
 void Qth::QthClient::setProperty(Property *property, const char *json) {
+#ifdef QTH_THREADSAFE
+	if (defer(property, Qth::PublishQueue::SET_PROPERTY, json)) {
+		return;
+	}
+#endif
 	mqtt.publish(property->name, json, true);
 }
 
 void Qth::QthClient::sendEvent(Event *event, const char *json) {
+#ifdef QTH_THREADSAFE
+	if (defer(event, Qth::PublishQueue::SEND_EVENT, json)) {
+		return;
+	}
+#endif
 	mqtt.publish(event->name, json, false);
 }
@@ -4,6 +4,12 @@
 #include <PubSubClient.h>
 #include <Client.h>
 
+#include "QthAllocator.h"
+#include "QthStorage.h"
+#include "QthBufferedClient.h"
+#include "QthInboundQueue.h"
+#include "QthPublishQueue.h"
+
 #if MQTT_MAX_PACKET_SIZE < 512
 #error "Insufficient MQTT packet size: Add build_flags = -DMQTT_MAX_PACKET_SIZE=512 (or similar) to platformio.ini"
 #endif
@@ -30,6 +36,14 @@ namespace Qth {
 			
 			QthClient *qth;
 			
+			uint8_t priority;
+			
+			// Has a value been received since the last (re)connect? (Only
+			// meaningful for watched properties, see QthClient::isSynced().)
+			bool synced;
+			
+			bool isProperty() {return strncmp(behaviour, "PROPERTY", 8) == 0;}
+			
 			virtual void onConnect() {};
 			
 			virtual void call(const char *topic, const char *json) {
@@ -51,12 +65,22 @@ namespace Qth {
 				onUnregisterJson(onUnregisterJson),
 				nextRegistration(NULL),
 				nextSubscription(NULL),
-				qth(NULL)
+				qth(NULL),
+				priority(0),
+				synced(true)
 				{};
 			
 			virtual ~Entity() {};
+			
+			/**
+			 * Set the dispatch priority of received messages when using an
+			 * InboundQueue. Messages for higher priority entities are dispatched
+			 * first. The default priority is 0.
+			 */
+			void setPriority(uint8_t newPriority) {priority = newPriority;}
 		
 		friend class QthClient;
+		friend class InboundQueue;
 	};
 	
 	/**
@@ -138,7 +162,37 @@ namespace Qth {
 	 */
 	class StoredProperty : public Property {
 		protected:
+#ifdef QTH_THREADSAFE
+			// NB: Atomic since other tasks may read the value at any time (see
+			// get(char *, size_t))
+			std::atomic<char *> value;
+			
+			// Incremented before and after every change to the value (i.e. odd
+			// while the value is being changed)
+			std::atomic<uint32_t> sequence;
+			
+			// The buffer holding the value (reused while large enough)
+			char *buffer;
+			size_t capacity;
+#else
 			char *value;
+#endif
+			
+			/**
+			 * Make the value a (non-null-terminated) buffer of the given length
+			 * (excluding the null terminator) and return it. The buffer must then
+			 * be filled (using copyValue()) and terminated, followed by a call to
+			 * endSet().
+			 */
+			char *beginSet(size_t length);
+			void endSet();
+			
+			/**
+			 * Copy 'length' bytes into a buffer returned by beginSet(). (In
+			 * threaded mode other tasks may be copying the same bytes, see
+			 * get(char *, size_t).)
+			 */
+			static void copyValue(char *dst, const char *src, size_t length);
 			
 			virtual void _set(const char *newValue);
 			virtual void onConnect();
@@ -182,14 +236,16 @@ namespace Qth {
 			               callback_t callback=NULL) :
 				Property(name, callback, description, oneToMany, onUnregisterJson),
 				value(NULL)
+#ifdef QTH_THREADSAFE
+				, sequence(0),
+				buffer(NULL),
+				capacity(0)
+#endif
 			{
 				_set(initialValue);
 			};
 			
-			virtual ~StoredProperty() {
-				// Free storage
-				_set(NULL);
-			}
+			virtual ~StoredProperty();
 			
 			/**
 			 * Set the value of this property.
@@ -200,44 +256,86 @@ namespace Qth {
 			 * If this StoredProperty has been registered with Qth on this node (by
 			 * registerProperty), calling set() while disconnected will result in a
 			 * call to set the property once reconnected.
+			 *
+			 * In threaded mode (see QthClient::setPublishQueue()), when called
+			 * from a task other than the one running QthClient::loop(), the value
+			 * is changed by the next call to loop().
 			 */
 			virtual void set(const char *newValue);
 			
 			/**
 			 * Get the most recently recieved value of the property. The returned
 			 * pointer may be invalidated upon the next call to any Qth API.
+			 *
+			 * In threaded mode, use get(char *, size_t) instead from tasks other
+			 * than the one running QthClient::loop().
 			 */
 			virtual const char *get();
+			
+			/**
+			 * Copy the most recently recieved value of the property into the
+			 * supplied buffer, truncating it if necessary. Returns false (and
+			 * copies an empty string) if the property has no value. Returns false
+			 * (and copies nothing) if length is 0.
+			 *
+			 * In threaded mode (i.e. when compiled with QTH_THREADSAFE defined)
+			 * this may safely be called from any task: it never blocks and never
+			 * copies a partially changed value.
+			 */
+			virtual bool get(char *buf, size_t length);
 	};
 	
 	/**
-	 * Define an EEPROM-backed Qth Property, storing the most recent value
-	 * locally (convenience API).
+	 * Define a Qth Property whose most recent value is stored locally in a
+	 * persistent Storage (convenience API).
+	 *
+	 * Like a StoredProperty except the received value is stored in a Storage
+	 * (e.g. an EEPROMStorage, FileStorage or RTCStorage) and loaded on startup
+	 * to allow long-term persistance of values.
 	 *
-	 * Like a StoredProperty except the received value is stored in EEPROM and
-	 * loaded on startup to allow long-term persistance of values.
+	 * In threaded mode (see QthClient::setPublishQueue()) stored values are
+	 * loaded by the first call to QthClient::loop() (so that only the loop
+	 * task ever modifies them) and get(char *, size_t) never loads the value.
 	 */
-	class EEPROMProperty : public StoredProperty {
+	class PersistentProperty : public StoredProperty {
 		protected:
+			Storage &storage;
 			size_t maxLength;
-			size_t eepromAddress;
+			size_t address;
+			
+			// Has the stored value been loaded from storage yet?
+			bool loaded;
+
+#ifdef QTH_THREADSAFE
+			// Linked list of properties which may not have been loaded yet
+			static PersistentProperty *unloaded;
+			PersistentProperty *nextUnloaded;
+			
+			/**
+			 * Load all properties which haven't been loaded yet (called by
+			 * QthClient::loop() in threaded mode).
+			 */
+			static void loadAll();
+#endif
+			
+			/**
+			 * Load the value held in storage (if not already loaded) without
+			 * writing it back to storage or sending it to Qth.
+			 */
+			void load();
 			
 			virtual void _set(const char *newValue);
+			virtual void onConnect();
 		
 		public:
 			/**
-			 * Define an EEPROM-backed Qth property.
-			 *
-			 * You must ensure the Arduino 'EEPROM' library is ready-to-use when
-			 * creating instances of this class. In particular, on ESP8266-based
-			 * platforms this means EEPROM.begin() must have been called. This means
-			 * this class will have to be dynamically allocated.
+			 * Define a persisted Qth property.
 			 *
-			 * Property values are stored into EEPROM by this class which are
+			 * Property values are written into the storage by this class and are
 			 * reloaded on startup. You are responsible for allocating blocks of the
-			 * EEPROM address space of sufficient size.
+			 * storage's address space of sufficient size.
 			 *
-			 * You should initialise the EEPROM block chosen space to contain valid
+			 * You should initialise the chosen block of storage to contain valid
 			 * null-terminated JSON (or a zero-length string for an empty property)
 			 * before first use. Failing to do this will result in an invalid
 			 * property value being sent to Qth. Though this library will not crash
@@ -245,19 +343,78 @@ namespace Qth {
 			 * recieved values are not valid JSON.
 			 *
 			 * Though you can use setProperty to set this property, it is recommended
-			 * you use the set() method of this EEPROMProperty object. This will
-			 * ensure that set values are immediately stored in EEPROM and calling
-			 * get() will always return the latest value of the property, even while
-			 * disconnected from Qth or not watching the property.
+			 * you use the set() method of this PersistentProperty object. This will
+			 * ensure that set values are stored and calling get() will always
+			 * return the latest value of the property, even while disconnected from
+			 * Qth or not watching the property.
+			 *
+			 * Changed values are committed to the storage at the end of the next
+			 * QthClient::loop() (or call Storage::commit() to commit them
+			 * immediately).
+			 *
+			 * @param name The full Qth path of the property.
+			 * @param storage The Storage in which to keep the value.
+			 * @param maxLength The maximum number of bytes required to store the
+			 *        value of this property (including a NULL terminator). Any value
+			 *        longer than this will be truncated when stored.
+			 * @param address The address within the storage at which to store the
+			 *        value of this property. The property value will be written to
+			 *        the storage whenever it changes and be read the first time it
+			 *        is needed (i.e. on the first call to get() or upon
+			 *        connection). Loading the value never writes to the storage.
+			 * @param description A human readable description of the property.
+			 *        Needn't be provided if you don't register the property.
+			 * @param oneToMany Is this a one-to-many (vs many-to-one) property.
+			 *        Needn't be provided if you don't register the property.
+			 * @param onUnregisterJson A value to set the property to when this
+			 *        client disconnects from Qth. Set to an empty string to delete
+			 *        the property. Set to a valid JSON value to set it. Set to NULL
+			 *        to neither set or delete the property. Needn't be provided if
+			 *        you don't register the property.
+			 * @param callback Callback called with the path and JSON of the
+			 *        property whenever it changes.
+			 */
+			PersistentProperty(const char *name,
+			                   Storage &storage,
+			                   size_t maxLength=MQTT_MAX_PACKET_SIZE,
+			                   size_t address=0,
+			                   const char *description="",
+			                   bool oneToMany=false,
+			                   const char *onUnregisterJson="",
+			                   callback_t callback=NULL);
+			
+			virtual ~PersistentProperty();
+			
+			virtual const char *get();
+			virtual bool get(char *buf, size_t length);
+	};
+	
+#ifdef QTH_HAS_EEPROM
+	/**
+	 * Define an EEPROM-backed Qth Property, storing the most recent value
+	 * locally (convenience API).
+	 *
+	 * A PersistentProperty which uses the Arduino 'EEPROM' library (via
+	 * EEPROMStorage) for storage.
+	 */
+	class EEPROMProperty : public PersistentProperty {
+		public:
+			/**
+			 * Define an EEPROM-backed Qth property.
+			 *
+			 * You must ensure the Arduino 'EEPROM' library is ready-to-use before
+			 * the value of this property is first used. In particular, on
+			 * ESP8266-based platforms this means EEPROM.begin() must have been
+			 * called.
+			 *
+			 * See PersistentProperty for details.
 			 *
 			 * @param name The full Qth path of the property.
 			 * @param maxLength The maximum number of bytes required to store the
 			 *        value of this property (including a NULL terminator). Any value
 			 *        longer than this will be truncated when stored into EEPROM.
 			 * @param eepromAddress The EEPROM address offset at which to store the
-			 *        value of this property. The property value will be written to
-			 *        the EEPROM whenever it changes and be read upon the initial
-			 *        creation of this EEPROMProperty.
+			 *        value of this property.
 			 * @param description A human readable description of the property.
 			 *        Needn't be provided if you don't register the property.
 			 * @param oneToMany Is this a one-to-many (vs many-to-one) property.
@@ -276,10 +433,15 @@ namespace Qth {
 			               const char *description="",
 			               bool oneToMany=false,
 			               const char *onUnregisterJson="",
-			               callback_t callback=NULL);
+			               callback_t callback=NULL) :
+				PersistentProperty(name, EEPROMStorage::instance(), maxLength,
+				                   eepromAddress, description, oneToMany,
+				                   onUnregisterJson, callback)
+				{};
 			
-			virtual ~EEPROMProperty();
+			virtual ~EEPROMProperty() {};
 	};
+#endif
 	
 	/**
 	 * Define a Qth Event.
@@ -351,11 +513,27 @@ namespace Qth {
 	 * strings containing valid JSON data. Use a 3rd party library as required.
 	 */
 	class QthClient {
+		friend class StoredProperty;
+		friend class PersistentProperty;
+		friend class Storage;
+		
 		private:
 			// Since the PubSubClient does not provide a user-supplied argument for
 			// its callbacks we just assume QthClient is a singleton.
 			static QthClient *qth;
-			static void onMessageStatic(const char *topic, byte *payload,
+			
+			// Commits all Storage instances (set when a Storage is created)
+			static void (*commitStorage)();
+
+#ifdef QTH_THREADSAFE
+			// Loads all PersistentProperty values (set when a PersistentProperty
+			// is created)
+			static void (*loadPersistentProperties)();
+#endif
+			
+			// NB: Must match PubSubClient's callback signature exactly since on
+			// some platforms (e.g. AVR) it is a plain function pointer.
+			static void onMessageStatic(char *topic, uint8_t *payload,
 			                            unsigned int length) {
 				if (qth) {
 					qth->onMessage(topic, (const char *)payload, length);
@@ -369,13 +547,99 @@ namespace Qth {
 			void (*onConnectCallback)();
 			
 			unsigned long lastReconnect;
+			bool firstConnectAttempt;
 			
 			Entity *registrations;
 			Entity *subscriptions;
 			
+			// Persisted session state (see setSessionStorage())
+			struct SessionState {
+				uint32_t magic;
+				uint32_t registrationHash;
+				uint32_t subscriptionHash;
+			};
+			Storage *sessionStorage;
+			size_t sessionAddress;
+			
+			// Was the current connection made with a clean (non-persistent)
+			// session?
+			bool cleanSession;
+			
+			// Initial-state sync tracking (see isSynced())
+			size_t unsyncedCount;
+			bool synced;
+			unsigned long syncStart;
+			unsigned long syncTimeout;
+			void (*syncCallback)(bool timedOut);
+			
+			// NB: The optional modules below are only used via virtual methods so
+			// that they are only linked into sketches which use them.
+			
+			// If non-NULL, the (buffered) network client to flush after each loop
+			BufferedClient *bufferedClient;
+			
+			// If non-NULL, the queue through which received messages are dispatched
+			InboundQueue *inboundQueue;
+
+#ifdef QTH_THREADSAFE
+			// If non-NULL, the queue of messages sent by other tasks
+			PublishQueue *publishQueue;
+			
+			// The task running loop() (once loopTaskKnown is true)
+			TaskId loopTask;
+			std::atomic<bool> loopTaskKnown;
+			
+			/**
+			 * When called from a task other than the loop task (and a publish
+			 * queue is in use), queue an action to be performed by loop() and
+			 * return true. Otherwise return false.
+			 */
+			bool defer(Entity *entity, PublishQueue::Action action, const char *json);
+#endif
+			
 			void onMessage(const char *topic, const char *payload, unsigned int length);
 			void onConnect();
+			
+			/**
+			 * Deliver a received value to a watched entity, updating the sync
+			 * state accordingly.
+			 */
+			void deliver(Entity *entity, const char *topic, const char *json);
+			
+			/**
+			 * Start waiting for the values of all watched properties to arrive
+			 * (or, if waitForValues is false, treat them all as received). Any
+			 * queued (stale) values of the properties waited for are discarded.
+			 */
+			void beginSync(bool waitForValues);
+			
+			/**
+			 * Declare the initial state synced and call the sync callback.
+			 */
+			void endSync(bool timedOut);
+			
+			/**
+			 * Generate the topic name "meta/clients/<clientId>". The returned
+			 * buffer must be freed with Qth::deallocate. Returns NULL if
+			 * allocation fails.
+			 */
+			char *buildClientTopic();
+			
+			/**
+			 * Write the registration JSON for this client into buf (if not NULL)
+			 * and return its length (excluding the null terminator).
+			 */
+			size_t writeRegistration(char *buf);
+			
+			/**
+			 * Generate the registration JSON for this client. The returned buffer
+			 * must be freed with Qth::deallocate. Returns NULL if allocation
+			 * fails.
+			 */
+			char *buildRegistration();
+			void sendRegistration(const char *registration);
 			void sendRegistration();
+			uint32_t subscriptionHash();
 			
 			void registerEntity(Entity *entity);
 			void unregisterEntity(Entity *entity);
@@ -405,10 +669,48 @@ namespace Qth {
 				description(description),
 				onConnectCallback(onConnectCallback),
 				lastReconnect(0),
+				firstConnectAttempt(true),
 				registrations(NULL),
-				subscriptions(NULL)
+				subscriptions(NULL),
+				sessionStorage(NULL),
+				sessionAddress(0),
+				cleanSession(true),
+				unsyncedCount(0),
+				synced(false),
+				syncStart(0),
+				syncTimeout(0),
+				syncCallback(NULL),
+				bufferedClient(NULL),
+				inboundQueue(NULL)
+#ifdef QTH_THREADSAFE
+				, publishQueue(NULL),
+				loopTaskKnown(false)
+#endif
 			{qth = this;};
 			
+			/**
+			 * Define a connection to a Qth (MQTT) server using a BufferedClient.
+			 *
+			 * Writes to the network are coalesced within each call to loop() and
+			 * flushed at the end of it.
+			 *
+			 * @param mqttServer Hostname or IP of the MQTT server.
+			 * @param client A BufferedClient wrapping the network Client (e.g. a
+			 *               WiFiClient) to be used.
+			 * @param clientId The unique ID of this Qth client.
+			 * @param description A description of this Qth client's purpose.
+			 * @param onConnectCallback A callback to call when a connection to Qth
+			 *                          is (re-)made.
+			 */
+			QthClient(const char *mqttServer,
+			          BufferedClient& client,
+			          const char *clientId,
+			          const char *description="",
+			          void (*onConnectCallback)()=NULL) :
+				QthClient(mqttServer, (Client &)client, clientId, description,
+				          onConnectCallback)
+			{bufferedClient = &client;};
+			
 			/**
 			 * Cycle the Qth mainloop, reconnecting to Qth automatically as required.
 			 * Call frequently.
@@ -421,6 +723,113 @@ namespace Qth {
 			 */
 			bool connected();
 			
+			/**
+			 * Persist MQTT session state in the supplied Storage (e.g. an
+			 * RTCStorage) to allow fast resumption after deep sleep. Call before
+			 * the first call to loop().
+			 *
+			 * When enabled, the client connects with a persistent (non-clean)
+			 * MQTT session. If the previous connection was ended by disconnect(),
+			 * the registration and subscriptions are only re-sent on reconnection
+			 * if they have changed. Values sent to watched properties and events
+			 * while disconnected are queued by the server (at QoS 1) and delivered
+			 * on reconnection.
+			 *
+			 * If the subscriptions have changed since the previous session (e.g.
+			 * the sketch now watches different properties), the client instead
+			 * connects with a clean session to discard the stale subscriptions
+			 * (which would otherwise continue to be delivered). This session
+			 * can't be resumed so the following connection re-sends everything
+			 * and starts a new persistent session.
+			 *
+			 * NB: This relies on the MQTT server retaining sessions while the
+			 * client is disconnected. If the server loses the session (e.g. it is
+			 * restarted without persistence), subscriptions will not be restored
+			 * until the client next connects without a cleanly ended session.
+			 *
+			 * @param storage The Storage in which to keep the session state.
+			 * @param address The address within the storage to use (requires 12
+			 *        bytes).
+			 */
+			void setSessionStorage(Storage *storage, size_t address=0) {
+				sessionStorage = storage;
+				sessionAddress = address;
+			}
+			
+			/**
+			 * Have the values of all watched properties been received since the
+			 * last (re)connection to Qth?
+			 *
+			 * Upon each (re)connection, the server sends the current (retained)
+			 * value of every watched property. Until all of these have arrived
+			 * (and been passed to their callbacks or StoredProperty objects),
+			 * local copies may be stale or just their initial values. Use this to
+			 * start acting on Qth state as soon as it is complete rather than
+			 * waiting for a fixed delay.
+			 *
+			 * Watched events are not waited for. Watching a new property while
+			 * synced makes the client unsynced until that property's value
+			 * arrives. A resumed session (see setSessionStorage()) is synced
+			 * immediately since the server does not resend retained values.
+			 *
+			 * NB: Properties which have no value in Qth are never received so
+			 * use setSyncTimeout() if any of your watched properties may be
+			 * unset.
+			 */
+			bool isSynced() {return synced && mqtt.connected();}
+			
+			/**
+			 * Set a callback to be called whenever the client becomes synced (see
+			 * isSynced()). The 'timedOut' argument is true if the sync timeout
+			 * expired before all values were received.
+			 */
+			void setSyncCallback(void (*callback)(bool timedOut)) {syncCallback = callback;}
+			
+			/**
+			 * Treat the client as synced if the values of all watched properties
+			 * have not been received within the given number of milliseconds of
+			 * (re)connecting (or of watching a new property). Set to 0 to wait
+			 * indefinitely (the default).
+			 */
+			void setSyncTimeout(unsigned long timeout) {syncTimeout = timeout;}
+			
+			/**
+			 * Dispatch received messages to watched properties and events via the
+			 * supplied InboundQueue during loop() rather than immediately upon
+			 * receipt. Set to NULL to dispatch messages immediately (the default).
+			 */
+			void setInboundQueue(InboundQueue *queue) {inboundQueue = queue;}
+
+#ifdef QTH_THREADSAFE
+			/**
+			 * Enable threaded mode, allowing loop() to run in its own task (e.g.
+			 * pinned to the network core of an ESP32) while another task uses
+			 * this client. Requires QTH_THREADSAFE to be defined when compiling
+			 * the library.
+			 *
+			 * In threaded mode, setProperty(), sendEvent() and StoredProperty's
+			 * set() may be called from one task other than the loop task. These
+			 * calls are placed in the supplied queue and carried out by the next
+			 * call to loop(). StoredProperty's get(char *, size_t) may be called
+			 * from any task. All other calls (e.g. registering and watching
+			 * properties) must be made from the loop task or before loop() is
+			 * first called.
+			 */
+			void setPublishQueue(PublishQueue *queue) {publishQueue = queue;}
+#endif
+			
+			/**
+			 * Cleanly disconnect from Qth, e.g. before entering deep sleep. If a
+			 * session storage is in use, the session state is saved such that the
+			 * next connection may be resumed quickly (see setSessionStorage()).
+			 * All pending Storage writes (e.g. PersistentProperty values set since
+			 * the last loop()) are committed, even if the connection has already
+			 * been lost.
+			 *
+			 * The client will automatically reconnect on the next call to loop().
+			 */
+			void disconnect();
+			
 			/**
 			 * Register the specified Property with Qth. (NB: Doesn't automatically
 			 * watch the property, see watchProperty()).
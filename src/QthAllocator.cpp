@@ -0,0 +1,39 @@
+#include "QthAllocator.h"
+
+// NB: A plain pointer (rather than a default Allocator object) so that
+// allocations made during static initialisation are safe.
+static Qth::Allocator *allocator = NULL;
+
+// The number of blocks allocated by the library which have not yet been freed.
+static size_t liveBlocks = 0;
+
+bool Qth::setAllocator(Qth::Allocator *newAllocator) {
+	// Blocks owned by an installed allocator must be returned to it
+	if (allocator && newAllocator != allocator && liveBlocks) {
+		return false;
+	}
+	
+	allocator = newAllocator;
+	return true;
+}
+
+void *Qth::allocate(size_t size) {
+	void *ptr = allocator ? allocator->allocate(size) : malloc(size);
+	if (ptr) {
+		liveBlocks++;
+	}
+	return ptr;
+}
+
+void Qth::deallocate(void *ptr) {
+	if (!ptr) {
+		return;
+	}
+	
+	liveBlocks--;
+	if (allocator) {
+		allocator->deallocate(ptr);
+	} else {
+		free(ptr);
+	}
+}
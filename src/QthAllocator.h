@@ -0,0 +1,121 @@
+#ifndef QTH_ALLOCATOR_H
+#define QTH_ALLOCATOR_H
+
+#include <Arduino.h>
+
+namespace Qth {
+	
+	/**
+	 * A memory allocator used for all of the library's dynamic allocations
+	 * (see setAllocator()).
+	 */
+	class Allocator {
+		public:
+			virtual ~Allocator() {};
+			
+			/**
+			 * Allocate 'size' bytes, returning NULL on failure.
+			 */
+			virtual void *allocate(size_t size) = 0;
+			
+			/**
+			 * Free memory returned by allocate().
+			 */
+			virtual void deallocate(void *ptr) = 0;
+	};
+	
+	/**
+	 * A bounded allocator which allocates from a fixed-size arena, making the
+	 * library's worst-case memory usage known up-front.
+	 *
+	 * Allocations are made first-fit with adjacent free blocks being merged as
+	 * required. Use the statistics (e.g. getPeak() and getFailures()) to size
+	 * the arena during development.
+	 *
+	 * Memory not allocated from the arena (e.g. allocated before the allocator
+	 * was installed with setAllocator()) is passed to free() when deallocated.
+	 */
+	class PoolAllocator : public Allocator {
+		protected:
+			// Arena bounds (aligned)
+			char *start;
+			char *end;
+			
+			size_t used;
+			size_t peak;
+			unsigned long failures;
+		
+		public:
+			/**
+			 * @param arena The memory to allocate from.
+			 * @param size The size of the arena (bytes).
+			 */
+			PoolAllocator(void *arena, size_t size);
+			
+			virtual void *allocate(size_t size);
+			virtual void deallocate(void *ptr);
+			
+			/**
+			 * Get the usable size of the arena (bytes).
+			 */
+			size_t getSize() {return end - start;}
+			
+			/**
+			 * Get the number of bytes currently allocated (including overheads).
+			 */
+			size_t getUsed() {return used;}
+			
+			/**
+			 * Get the maximum value of getUsed() so far.
+			 */
+			size_t getPeak() {return peak;}
+			
+			/**
+			 * Get the number of allocations which have failed.
+			 */
+			unsigned long getFailures() {return failures;}
+			
+			/**
+			 * Get the size of the largest allocation which could currently be
+			 * made (bytes).
+			 */
+			size_t getLargestFree();
+			
+			/**
+			 * Get the percentage of free memory which is not part of the largest
+			 * free block (0 when unfragmented).
+			 */
+			unsigned int getFragmentation();
+	};
+	
+	/**
+	 * Use the supplied Allocator for all allocations made by this library. Set
+	 * to NULL to use malloc (the default).
+	 *
+	 * This should be called as early as possible, before creating any
+	 * QthClient, StoredProperty or other library objects. Note that global
+	 * StoredProperty objects with an initial value allocate memory before
+	 * setup() is called: memory allocated with malloc before an Allocator is
+	 * installed is later passed to that Allocator's deallocate() which must
+	 * pass it on to free() (as PoolAllocator does).
+	 *
+	 * Once an Allocator is installed it cannot be replaced (or removed) while
+	 * any memory allocated by the library remains allocated.
+	 *
+	 * @returns true if the Allocator was changed, false if it was rejected
+	 *          because memory is still allocated.
+	 */
+	bool setAllocator(Allocator *newAllocator);
+	
+	/**
+	 * Allocate memory using the current Allocator (see setAllocator()).
+	 */
+	void *allocate(size_t size);
+	
+	/**
+	 * Free memory allocated by allocate(). Does nothing if ptr is NULL.
+	 */
+	void deallocate(void *ptr);
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "QthAllocator.h"
+#include "QthBufferedClient.h"
+
+Qth::BufferedClient::BufferedClient(Client &client, size_t size) :
+	client(client),
+	buffer((uint8_t *)Qth::allocate(size)),
+	size(buffer ? size : 0),
+	used(0),
+	writes(0),
+	segments(0)
+{
+}
+
+Qth::BufferedClient::~BufferedClient() {
+	Qth::deallocate(buffer);
+}
+
+void Qth::BufferedClient::flushWrites() {
+	if (used) {
+		size_t length = used;
+		used = 0;
+		segments++;
+		
+		// Since we've already told the writer this data was sent, close the
+		// connection on failure so that the error is detected.
+		if (client.write(buffer, length) != length) {
+			client.stop();
+		}
+	}
+}
+
+int Qth::BufferedClient::connect(IPAddress ip, uint16_t port) {
+	used = 0;
+	return client.connect(ip, port);
+}
+
+int Qth::BufferedClient::connect(const char *host, uint16_t port) {
+	used = 0;
+	return client.connect(host, port);
+}
+
+size_t Qth::BufferedClient::write(uint8_t b) {
+	return write(&b, 1);
+}
+
+size_t Qth::BufferedClient::write(const uint8_t *buf, size_t length) {
+	writes++;
+	
+	if (used + length > size) {
+		flushWrites();
+	}
+	
+	if (length > size) {
+		// Too large to buffer: send immediately
+		segments++;
+		return client.write(buf, length);
+	} else {
+		memcpy(buffer + used, buf, length);
+		used += length;
+		return length;
+	}
+}
+
+// NB: Any buffered data is sent before reading since the reader may be
+// waiting for a response to it.
+
+int Qth::BufferedClient::available() {
+	flushWrites();
+	return client.available();
+}
+
+int Qth::BufferedClient::read() {
+	flushWrites();
+	return client.read();
+}
+
+int Qth::BufferedClient::read(uint8_t *buf, size_t length) {
+	flushWrites();
+	return client.read(buf, length);
+}
+
+int Qth::BufferedClient::peek() {
+	flushWrites();
+	return client.peek();
+}
+
+void Qth::BufferedClient::flush() {
+	flushWrites();
+	client.flush();
+}
+
+void Qth::BufferedClient::stop() {
+	flushWrites();
+	client.stop();
+}
+
+uint8_t Qth::BufferedClient::connected() {
+	return client.connected();
+}
+
+Qth::BufferedClient::operator bool() {
+	return (bool)client;
+}
@@ -0,0 +1,87 @@
+#ifndef QTH_BUFFERED_CLIENT_H
+#define QTH_BUFFERED_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#ifndef QTH_BUFFERED_CLIENT_SIZE
+#define QTH_BUFFERED_CLIENT_SIZE 512
+#endif
+
+namespace Qth {
+	
+	/**
+	 * A network Client wrapper which coalesces many small writes into fewer,
+	 * larger writes.
+	 *
+	 * PubSubClient makes several small writes per MQTT packet and QthClient
+	 * sends bursts of packets (e.g. upon connection). On a WiFiClient each
+	 * write may otherwise become its own TCP segment.
+	 *
+	 * Written data is buffered until the buffer fills, until data is read from
+	 * the connection or until flushWrites() is called. When passed to a
+	 * QthClient, the buffer is also flushed at the end of every
+	 * QthClient::loop(). (NB: Data sent by calls made outside of
+	 * QthClient::loop() is therefore sent at the next call to loop().)
+	 */
+	class BufferedClient : public Client {
+		protected:
+			Client &client;
+			
+			uint8_t *buffer;
+			size_t size;
+			size_t used;
+			
+			unsigned long writes;
+			unsigned long segments;
+		
+		public:
+			/**
+			 * @param client The network Client to wrap (e.g. a WiFiClient).
+			 * @param size The size of the write buffer (in bytes).
+			 */
+			BufferedClient(Client &client, size_t size=QTH_BUFFERED_CLIENT_SIZE);
+			
+			virtual ~BufferedClient();
+			
+			/**
+			 * Send any buffered data to the underlying Client.
+			 */
+			virtual void flushWrites();
+			
+			/**
+			 * Get the number of write calls made to this Client.
+			 */
+			unsigned long getWrites() {return writes;}
+			
+			/**
+			 * Get the number of write calls made to the underlying Client.
+			 */
+			unsigned long getSegments() {return segments;}
+			
+			/**
+			 * Get the number of write calls saved by buffering.
+			 */
+			unsigned long getWritesSaved() {return writes - segments;}
+			
+			/**
+			 * Reset the write statistics counters.
+			 */
+			void resetStats() {writes = 0; segments = 0;}
+			
+			virtual int connect(IPAddress ip, uint16_t port);
+			virtual int connect(const char *host, uint16_t port);
+			virtual size_t write(uint8_t b);
+			virtual size_t write(const uint8_t *buf, size_t size);
+			virtual int available();
+			virtual int read();
+			virtual int read(uint8_t *buf, size_t size);
+			virtual int peek();
+			virtual void flush();
+			virtual void stop();
+			virtual uint8_t connected();
+			virtual operator bool();
+	};
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "QthStorage.h"
+
+#ifdef QTH_HAS_EEPROM
+
+#include <EEPROM.h>
+
+Qth::EEPROMStorage &Qth::EEPROMStorage::instance() {
+	static Qth::EEPROMStorage storage;
+	return storage;
+}
+
+size_t Qth::EEPROMStorage::getSize() {
+	return EEPROM.length();
+}
+
+const char *Qth::EEPROMStorage::getDataPtr(size_t address) {
+	// The ESP8266 and ESP32 EEPROM libraries keep a RAM copy of the EEPROM
+	// which may be read in bulk. (NB: On ESP32 this marks the EEPROM library's
+	// copy dirty but it is only ever committed after a write anyway.)
+#if defined(ESP8266)
+	const uint8_t *data = EEPROM.getConstDataPtr();
+#elif defined(ESP32)
+	const uint8_t *data = EEPROM.getDataPtr();
+#else
+	const uint8_t *data = NULL;
+#endif
+	return data ? (const char *)data + address : NULL;
+}
+
+void Qth::EEPROMStorage::readBytes(size_t address, char *buf, size_t length) {
+#ifdef __AVR__
+	eeprom_read_block(buf, (const void *)address, length);
+#else
+	for (size_t i = 0; i < length; i++) {
+		buf[i] = EEPROM.read(address + i);
+	}
+#endif
+}
+
+void Qth::EEPROMStorage::writeBytes(size_t address, const char *buf, size_t length) {
+#ifdef __AVR__
+	// NB: Only writes changed bytes to reduce wear
+	eeprom_update_block(buf, (void *)address, length);
+#else
+	for (size_t i = 0; i < length; i++) {
+#if defined(ESP8266) || defined(ESP32)
+		EEPROM.write(address + i, buf[i]);
+#else
+		// NB: Only writes changed bytes to reduce wear
+		EEPROM.update(address + i, buf[i]);
+#endif
+	}
+#endif
+}
+
+void Qth::EEPROMStorage::commitBytes() {
+#if defined(ESP8266) || defined(ESP32)
+	EEPROM.commit();
+#else
+	// Other platforms (e.g. AVR) write to the EEPROM immediately
+#endif
+}
+
+#endif
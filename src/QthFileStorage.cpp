@@ -0,0 +1,110 @@
+#if defined(ESP8266) || defined(ESP32)
+
+#include "QthAllocator.h"
+#include "QthStorage.h"
+
+// Generate the path of the temporary file used while committing
+// ("<path>.tmp"). The returned buffer must be freed with Qth::deallocate.
+// Returns NULL if allocation fails.
+static char *buildTempPath(const char *path) {
+	size_t len = strlen(path);
+	char *tempPath = (char *)Qth::allocate(len + 5);
+	if (tempPath) {
+		memcpy(tempPath, path, len);
+		memcpy(tempPath + len, ".tmp", 5);
+	}
+	return tempPath;
+}
+
+Qth::FileStorage::~FileStorage() {
+	commit();
+	Qth::deallocate(image);
+}
+
+void Qth::FileStorage::loadImage() {
+	if (image) {
+		return;
+	}
+	
+	image = (char *)Qth::allocate(size);
+	if (!image) {
+		return;
+	}
+	
+	// NB: Any part of the image not present in the file is zero-filled
+	memset(image, 0, size);
+	fs::File file;
+	if (fs.exists(path)) {
+		file = fs.open(path, "r");
+	} else {
+		// A commit may have been interrupted after removing the old file but
+		// before renaming the new one into place (see commitBytes())
+		char *tempPath = buildTempPath(path);
+		if (tempPath && fs.exists(tempPath)) {
+			file = fs.open(tempPath, "r");
+		}
+		Qth::deallocate(tempPath);
+	}
+	if (file) {
+		file.read((uint8_t *)image, size);
+		file.close();
+	}
+}
+
+const char *Qth::FileStorage::getDataPtr(size_t address) {
+	loadImage();
+	return image ? image + address : NULL;
+}
+
+void Qth::FileStorage::readBytes(size_t address, char *buf, size_t length) {
+	loadImage();
+	if (image) {
+		memcpy(buf, image + address, length);
+	} else {
+		memset(buf, 0, length);
+	}
+}
+
+void Qth::FileStorage::writeBytes(size_t address, const char *buf, size_t length) {
+	loadImage();
+	if (image) {
+		memcpy(image + address, buf, length);
+	}
+}
+
+void Qth::FileStorage::commitBytes() {
+	// NB: Without an image there is nothing to write (and opening the file for
+	// writing would truncate it).
+	if (!image) {
+		return;
+	}
+	
+	// The new contents are written to a temporary file which only replaces
+	// the old file once complete so that losing power part way through a
+	// commit can't lose every stored value.
+	char *tempPath = buildTempPath(path);
+	if (!tempPath) {
+		return;
+	}
+	
+	bool written = false;
+	fs::File file = fs.open(tempPath, "w");
+	if (file) {
+		written = file.write((const uint8_t *)image, size) == size;
+		file.close();
+	}
+	
+	if (written) {
+		// NB: Some filesystems (e.g. SPIFFS) can't rename over an existing file
+		if (!fs.rename(tempPath, path)) {
+			fs.remove(path);
+			fs.rename(tempPath, path);
+		}
+	} else {
+		fs.remove(tempPath);
+	}
+	
+	Qth::deallocate(tempPath);
+}
+
+#endif
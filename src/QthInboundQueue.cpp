@@ -0,0 +1,104 @@
+#include "Qth.h"
+
+Qth::InboundQueue::InboundQueue(size_t numSlots,
+                                size_t maxLength,
+                                size_t budget) :
+	slots((Slot *)Qth::allocate(numSlots * sizeof(Slot))),
+	numSlots(numSlots),
+	maxLength(maxLength),
+	budget(budget),
+	payloads((char *)Qth::allocate(numSlots * (maxLength + 1))),
+	nextSequence(0),
+	overflows(0),
+	oversized(0),
+	coalesced(0)
+{
+	// If allocation failed, the queue behaves as if always full
+	if (!slots || !payloads) {
+		this->numSlots = 0;
+	}
+	
+	for (size_t i = 0; i < this->numSlots; i++) {
+		slots[i].entity = NULL;
+		slots[i].payload = payloads + (i * (maxLength + 1));
+	}
+}
+
+Qth::InboundQueue::~InboundQueue() {
+	Qth::deallocate(slots);
+	Qth::deallocate(payloads);
+}
+
+bool Qth::InboundQueue::push(Qth::Entity *entity, const char *payload, unsigned int length) {
+	if (length > maxLength) {
+		oversized++;
+		return false;
+	}
+	
+	// Only the latest value of a property matters so replace any queued value
+	// (retaining its place in the queue).
+	Slot *slot = NULL;
+	if (entity->isProperty()) {
+		for (size_t i = 0; i < numSlots; i++) {
+			if (slots[i].entity == entity) {
+				slot = &slots[i];
+				coalesced++;
+				break;
+			}
+		}
+	}
+	
+	// Otherwise take a free slot
+	if (!slot) {
+		for (size_t i = 0; i < numSlots; i++) {
+			if (!slots[i].entity) {
+				slot = &slots[i];
+				slot->entity = entity;
+				slot->sequence = nextSequence++;
+				break;
+			}
+		}
+	}
+	
+	if (!slot) {
+		overflows++;
+		return false;
+	}
+	
+	memcpy(slot->payload, payload, length);
+	slot->payload[length] = '\0';
+	
+	return true;
+}
+
+Qth::Entity *Qth::InboundQueue::pop(const char **payload) {
+	// Find the oldest message with the highest priority
+	Slot *next = NULL;
+	for (size_t i = 0; i < numSlots; i++) {
+		Slot *slot = &slots[i];
+		if (slot->entity && (
+		    !next ||
+		    slot->entity->priority > next->entity->priority ||
+		    (slot->entity->priority == next->entity->priority &&
+		     (long)(slot->sequence - next->sequence) < 0))) {
+			next = slot;
+		}
+	}
+	
+	if (!next) {
+		return NULL;
+	}
+	
+	Qth::Entity *entity = next->entity;
+	*payload = next->payload;
+	next->entity = NULL;
+	return entity;
+}
+
+void Qth::InboundQueue::remove(Qth::Entity *entity) {
+	for (size_t i = 0; i < this->numSlots; i++) {
+		if (slots[i].entity == entity) {
+			slots[i].entity = NULL;
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef QTH_INBOUND_QUEUE_H
+#define QTH_INBOUND_QUEUE_H
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+namespace Qth {
+	
+	class Entity;
+	
+	/**
+	 * A bounded queue of received messages awaiting dispatch to watched
+	 * properties and events.
+	 *
+	 * By default, callbacks are called from within PubSubClient's receive
+	 * handler meaning slow callbacks delay network processing and a burst of
+	 * messages (e.g. retained values on connection) are all handled at once.
+	 * When an InboundQueue is given to QthClient::setInboundQueue(), received
+	 * messages are instead copied into the queue and dispatched during
+	 * QthClient::loop(), at most 'budget' messages per loop.
+	 *
+	 * Messages for entities with a higher priority (see Entity::setPriority())
+	 * are dispatched first, otherwise messages are dispatched in the order
+	 * received. If a new value arrives for a property which already has a
+	 * value queued, the queued value is replaced with the new one.
+	 *
+	 * Messages which arrive while the queue is full or which are longer than
+	 * the maximum length are dropped (and counted).
+	 */
+	class InboundQueue {
+		protected:
+			struct Slot {
+				// The entity the message is for (NULL if the slot is free)
+				Entity *entity;
+				// Order of arrival
+				unsigned long sequence;
+				char *payload;
+			};
+			
+			Slot *slots;
+			size_t numSlots;
+			size_t maxLength;
+			size_t budget;
+			
+			// Storage for all slot payloads
+			char *payloads;
+			
+			unsigned long nextSequence;
+			
+			unsigned long overflows;
+			unsigned long oversized;
+			unsigned long coalesced;
+		
+		public:
+			/**
+			 * @param numSlots The maximum number of messages which may be queued.
+			 * @param maxLength The maximum length of a message payload (bytes).
+			 * @param budget The maximum number of messages to dispatch per call to
+			 *        QthClient::loop().
+			 */
+			InboundQueue(size_t numSlots,
+			             size_t maxLength=MQTT_MAX_PACKET_SIZE,
+			             size_t budget=4);
+			
+			virtual ~InboundQueue();
+			
+			/**
+			 * Copy a message into the queue. Returns false if the message was
+			 * dropped.
+			 */
+			virtual bool push(Entity *entity, const char *payload, unsigned int length);
+			
+			/**
+			 * Remove the next message to be dispatched from the queue. Returns
+			 * NULL if the queue is empty. Otherwise returns the entity and sets
+			 * *payload to the null-terminated payload, which remains valid until
+			 * the next call to push().
+			 */
+			virtual Entity *pop(const char **payload);
+			
+			/**
+			 * Remove all queued messages for an entity.
+			 */
+			virtual void remove(Entity *entity);
+			
+			/**
+			 * Get the maximum number of messages to dispatch per loop.
+			 */
+			size_t getBudget() {return budget;}
+			
+			/**
+			 * Get the number of messages dropped due to the queue being full.
+			 */
+			unsigned long getOverflows() {return overflows;}
+			
+			/**
+			 * Get the number of messages dropped due to being too long.
+			 */
+			unsigned long getOversized() {return oversized;}
+			
+			/**
+			 * Get the number of queued property values replaced by newer values.
+			 */
+			unsigned long getCoalesced() {return coalesced;}
+	};
+}
+
+#endif
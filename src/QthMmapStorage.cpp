@@ -0,0 +1,62 @@
+#ifndef ARDUINO
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "QthStorage.h"
+
+Qth::MmapStorage::MmapStorage(const char *path, size_t size) :
+	fd(-1),
+	size(size),
+	data(NULL)
+{
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return;
+	}
+	
+	// NB: Extending the file zero-fills it
+	if (ftruncate(fd, size) == 0) {
+		void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (mapping != MAP_FAILED) {
+			data = (char *)mapping;
+		}
+	}
+}
+
+Qth::MmapStorage::~MmapStorage() {
+	if (data) {
+		commit();
+		munmap(data, size);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+const char *Qth::MmapStorage::getDataPtr(size_t address) {
+	return data ? data + address : NULL;
+}
+
+void Qth::MmapStorage::readBytes(size_t address, char *buf, size_t length) {
+	if (data) {
+		memcpy(buf, data + address, length);
+	} else {
+		memset(buf, 0, length);
+	}
+}
+
+void Qth::MmapStorage::writeBytes(size_t address, const char *buf, size_t length) {
+	if (data) {
+		memcpy(data + address, buf, length);
+	}
+}
+
+void Qth::MmapStorage::commitBytes() {
+	if (data) {
+		msync(data, size, MS_SYNC);
+	}
+}
+
+#endif
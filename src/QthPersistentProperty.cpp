@@ -0,0 +1,162 @@
+#include "Qth.h"
+
+#ifdef QTH_THREADSAFE
+Qth::PersistentProperty *Qth::PersistentProperty::unloaded = NULL;
+#endif
+
+Qth::PersistentProperty::PersistentProperty(const char *name,
+                                            Qth::Storage &storage,
+                                            size_t maxLength,
+                                            size_t address,
+                                            const char *description,
+                                            bool oneToMany,
+                                            const char *onUnregisterJson,
+                                            Qth::callback_t callback) :
+	StoredProperty(name, NULL, description, oneToMany, onUnregisterJson, callback),
+	storage(storage),
+	maxLength(maxLength),
+	address(address),
+	loaded(false)
+#ifdef QTH_THREADSAFE
+	, nextUnloaded(unloaded)
+#endif
+{
+#ifdef QTH_THREADSAFE
+	unloaded = this;
+	
+	// NB: Hooked in here so that sketches without persistent properties don't
+	// include them
+	Qth::QthClient::loadPersistentProperties = loadAll;
+#endif
+}
+
+Qth::PersistentProperty::~PersistentProperty() {
+#ifdef QTH_THREADSAFE
+	// Remove from list
+	Qth::PersistentProperty **propertyPtr = &unloaded;
+	while (*propertyPtr) {
+		if ((*propertyPtr) == this) {
+			*propertyPtr = nextUnloaded;
+		} else {
+			propertyPtr = &((*propertyPtr)->nextUnloaded);
+		}
+	}
+#endif
+}
+
+#ifdef QTH_THREADSAFE
+void Qth::PersistentProperty::loadAll() {
+	while (unloaded) {
+		Qth::PersistentProperty *property = unloaded;
+		unloaded = property->nextUnloaded;
+		property->load();
+	}
+}
+#endif
+
+void Qth::PersistentProperty::load() {
+	if (loaded) {
+		return;
+	}
+	loaded = true;
+	
+	// NB: The value is read directly into the stored value (bypassing _set,
+	// which would write the value straight back into storage).
+	const char *stored = storage.getDataPtr(address);
+	if (stored) {
+		// The storage keeps a copy in RAM: copy just the stored string
+		size_t maxLen = storage.clampLength(address, maxLength - 1);
+		const char *end = (const char *)memchr(stored, '\0', maxLen);
+		size_t len = end ? (size_t)(end - stored) : maxLen;
+		char *newValue = beginSet(len);
+		if (newValue) {
+			copyValue(newValue, stored, len);
+			copyValue(newValue + len, "", 1);
+		}
+	} else {
+		// Find the length of the stored string (terminated by the first null
+		// within it) a chunk at a time so that the value can be read straight
+		// into a buffer of exactly the right size.
+		size_t maxLen = storage.clampLength(address, maxLength - 1);
+		char chunk[16];
+		size_t len = 0;
+		while (len < maxLen) {
+			size_t chunkLen = maxLen - len;
+			if (chunkLen > sizeof(chunk)) {
+				chunkLen = sizeof(chunk);
+			}
+			storage.read(address + len, chunk, chunkLen);
+			const char *end = (const char *)memchr(chunk, '\0', chunkLen);
+			if (end) {
+				len += end - chunk;
+				break;
+			}
+			len += chunkLen;
+		}
+		
+		char *newValue = beginSet(len);
+		if (newValue) {
+#ifdef QTH_THREADSAFE
+			// NB: Copied via the chunk buffer since other tasks may be reading
+			// the value (see copyValue())
+			for (size_t i = 0; i < len; i += sizeof(chunk)) {
+				size_t chunkLen = len - i;
+				if (chunkLen > sizeof(chunk)) {
+					chunkLen = sizeof(chunk);
+				}
+				storage.read(address + i, chunk, chunkLen);
+				copyValue(newValue + i, chunk, chunkLen);
+			}
+#else
+			storage.read(address, newValue, len);
+#endif
+			copyValue(newValue + len, "", 1);
+		}
+	}
+	endSet();
+}
+
+const char *Qth::PersistentProperty::get() {
+	load();
+	return StoredProperty::get();
+}
+
+bool Qth::PersistentProperty::get(char *buf, size_t length) {
+	// NB: In threaded mode this may be called from any task so the value is
+	// loaded by QthClient::loop() instead
+#ifndef QTH_THREADSAFE
+	load();
+#endif
+	return StoredProperty::get(buf, length);
+}
+
+void Qth::PersistentProperty::onConnect() {
+	load();
+	StoredProperty::onConnect();
+}
+
+void Qth::PersistentProperty::_set(const char *newValue) {
+	// Persist into storage (NB: can't represent NULL value in storage so just
+	// ignore this).
+	if (newValue) {
+		// NB: The stored value must be loaded to be compared against (e.g. a
+		// watched but unregistered property may not have been loaded yet).
+		load();
+		
+		// Don't wear out the storage re-writing an unchanged value (e.g. when
+		// the stored value is re-sent on connection).
+		if (value && strcmp(value, newValue) == 0) {
+			return;
+		}
+		
+		// NB: Truncated values are stored without a null terminator
+		size_t len = strlen(newValue) + 1;
+		if (len > maxLength) {
+			len = maxLength;
+		}
+		storage.write(address, newValue, len);
+		
+		// Store the value
+		StoredProperty::_set(newValue);
+	}
+}
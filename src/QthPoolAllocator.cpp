@@ -0,0 +1,114 @@
+#include "QthAllocator.h"
+
+// Each block in the arena begins with a header giving the size of the block
+// (including the header) with the least significant bit set when the block is
+// allocated.
+static const size_t ALIGN = 8;
+static const size_t HEADER = (sizeof(size_t) + ALIGN - 1) & ~(ALIGN - 1);
+static const size_t MIN_BLOCK = HEADER + ALIGN;
+
+static inline size_t blockSize(const char *block) {
+	return *(const size_t *)block & ~(size_t)1;
+}
+
+static inline bool blockUsed(const char *block) {
+	return *(const size_t *)block & 1;
+}
+
+static inline void setBlock(char *block, size_t size, bool used) {
+	*(size_t *)block = size | (used ? 1 : 0);
+}
+
+Qth::PoolAllocator::PoolAllocator(void *arena, size_t size) :
+	used(0),
+	peak(0),
+	failures(0)
+{
+	uintptr_t first = ((uintptr_t)arena + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+	uintptr_t last = ((uintptr_t)arena + size) & ~(uintptr_t)(ALIGN - 1);
+	start = (char *)first;
+	end = (char *)(last > first ? last : first);
+	
+	// Initially one big free block
+	if (end - start >= (ptrdiff_t)MIN_BLOCK) {
+		setBlock(start, end - start, false);
+	} else {
+		end = start;
+	}
+}
+
+void *Qth::PoolAllocator::allocate(size_t size) {
+	size_t needed = HEADER + ((size + ALIGN - 1) & ~(ALIGN - 1));
+	if (needed < MIN_BLOCK) {
+		needed = MIN_BLOCK;
+	}
+	
+	char *block = start;
+	while (block < end) {
+		size_t length = blockSize(block);
+		if (!blockUsed(block)) {
+			// Merge any following free blocks
+			char *next = block + length;
+			while (next < end && !blockUsed(next)) {
+				length += blockSize(next);
+				next = block + length;
+			}
+			setBlock(block, length, false);
+			
+			if (length >= needed) {
+				// Split off any unused space large enough to form a block
+				if (length - needed >= MIN_BLOCK) {
+					setBlock(block + needed, length - needed, false);
+					length = needed;
+				}
+				setBlock(block, length, true);
+				
+				used += length;
+				if (used > peak) {
+					peak = used;
+				}
+				return block + HEADER;
+			}
+		}
+		block += length;
+	}
+	
+	failures++;
+	return NULL;
+}
+
+void Qth::PoolAllocator::deallocate(void *ptr) {
+	char *block = (char *)ptr - HEADER;
+	if (block < start || block >= end) {
+		// Not allocated from the arena
+		free(ptr);
+		return;
+	}
+	
+	used -= blockSize(block);
+	setBlock(block, blockSize(block), false);
+}
+
+size_t Qth::PoolAllocator::getLargestFree() {
+	size_t largest = 0;
+	size_t run = 0;
+	for (char *block = start; block < end; block += blockSize(block)) {
+		if (blockUsed(block)) {
+			run = 0;
+		} else {
+			run += blockSize(block);
+			if (run > largest) {
+				largest = run;
+			}
+		}
+	}
+	return largest > HEADER ? largest - HEADER : 0;
+}
+
+unsigned int Qth::PoolAllocator::getFragmentation() {
+	size_t unused = getSize() - used;
+	if (unused <= HEADER) {
+		return 0;
+	}
+	return 100 - (unsigned int)((getLargestFree() * 100) / (unused - HEADER));
+}
@@ -0,0 +1,74 @@
+#ifdef QTH_THREADSAFE
+
+#include "Qth.h"
+
+Qth::PublishQueue::PublishQueue(size_t numSlots, size_t maxLength) :
+	slots((Slot *)Qth::allocate(numSlots * sizeof(Slot))),
+	numSlots(numSlots),
+	maxLength(maxLength),
+	payloads((char *)Qth::allocate(numSlots * (maxLength + 1))),
+	head(0),
+	tail(0),
+	overflows(0),
+	oversized(0)
+{
+	// If allocation failed, the queue behaves as if always full
+	if (!slots || !payloads) {
+		this->numSlots = 0;
+	}
+	
+	for (size_t i = 0; i < this->numSlots; i++) {
+		slots[i].payload = payloads + (i * (maxLength + 1));
+	}
+}
+
+Qth::PublishQueue::~PublishQueue() {
+	Qth::deallocate(slots);
+	Qth::deallocate(payloads);
+}
+
+bool Qth::PublishQueue::push(Qth::Entity *entity, Action action, const char *payload) {
+	size_t length = payload ? strlen(payload) : 0;
+	if (length > maxLength) {
+		oversized.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	
+	size_t t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) >= numSlots) {
+		overflows.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	
+	Slot *slot = &slots[t % numSlots];
+	slot->entity = entity;
+	slot->action = action;
+	slot->isNull = payload == NULL;
+	if (payload) {
+		memcpy(slot->payload, payload, length + 1);
+	}
+	
+	// Publish the slot to the consumer
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+Qth::Entity *Qth::PublishQueue::front(Action *action, const char **payload) {
+	size_t h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire)) {
+		return NULL;
+	}
+	
+	Slot *slot = &slots[h % numSlots];
+	*action = slot->action;
+	*payload = slot->isNull ? NULL : slot->payload;
+	return slot->entity;
+}
+
+void Qth::PublishQueue::pop() {
+	// Return the slot to the producer
+	head.store(head.load(std::memory_order_relaxed) + 1,
+	           std::memory_order_release);
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef QTH_PUBLISH_QUEUE_H
+#define QTH_PUBLISH_QUEUE_H
+
+#ifdef QTH_THREADSAFE
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+#include <atomic>
+#ifndef ESP32
+#include <thread>
+#endif
+
+namespace Qth {
+	
+	class Entity;
+
+#ifdef ESP32
+	// NB: FreeRTOS tasks (e.g. the Arduino loop task) are not pthreads so
+	// std::this_thread can't be used.
+	typedef TaskHandle_t TaskId;
+	inline TaskId currentTask() {return xTaskGetCurrentTaskHandle();}
+#else
+	typedef std::thread::id TaskId;
+	inline TaskId currentTask() {return std::this_thread::get_id();}
+#endif
+	
+	/**
+	 * A lock-free, single-producer, single-consumer queue of messages to be
+	 * sent by QthClient::loop() on behalf of another task.
+	 *
+	 * See QthClient::setPublishQueue().
+	 */
+	class PublishQueue {
+		public:
+			enum Action {
+				SET_PROPERTY,
+				SEND_EVENT,
+				SET_STORED_PROPERTY,
+			};
+		
+		protected:
+			struct Slot {
+				Entity *entity;
+				Action action;
+				// Payloads may be NULL (e.g. when setting a StoredProperty to NULL)
+				bool isNull;
+				char *payload;
+			};
+			
+			Slot *slots;
+			size_t numSlots;
+			size_t maxLength;
+			
+			// Storage for all slot payloads
+			char *payloads;
+			
+			// Free-running counts of slots popped (written only by the consumer)
+			// and pushed (written only by the producer).
+			std::atomic<size_t> head;
+			std::atomic<size_t> tail;
+			
+			std::atomic<unsigned long> overflows;
+			std::atomic<unsigned long> oversized;
+		
+		public:
+			/**
+			 * @param numSlots The maximum number of messages which may be queued.
+			 * @param maxLength The maximum length of a message payload (bytes).
+			 */
+			PublishQueue(size_t numSlots, size_t maxLength=MQTT_MAX_PACKET_SIZE);
+			
+			virtual ~PublishQueue();
+			
+			/**
+			 * Copy a message into the queue (producer only). Returns false if the
+			 * message was dropped.
+			 */
+			virtual bool push(Entity *entity, Action action, const char *payload);
+			
+			/**
+			 * Get the message at the front of the queue (consumer only). Returns
+			 * NULL if the queue is empty. Otherwise returns the entity and sets
+			 * *action and *payload. The payload remains valid until pop() is
+			 * called.
+			 */
+			virtual Entity *front(Action *action, const char **payload);
+			
+			/**
+			 * Remove the message at the front of the queue (consumer only).
+			 */
+			virtual void pop();
+			
+			/**
+			 * Get the number of messages dropped due to the queue being full.
+			 */
+			unsigned long getOverflows() {return overflows.load(std::memory_order_relaxed);}
+			
+			/**
+			 * Get the number of messages dropped due to being too long.
+			 */
+			unsigned long getOversized() {return oversized.load(std::memory_order_relaxed);}
+	};
+}
+
+#endif
+
+#endif
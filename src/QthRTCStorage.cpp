@@ -0,0 +1,99 @@
+#if defined(ESP8266) || defined(ESP32)
+
+#include "QthAllocator.h"
+#include "QthStorage.h"
+
+#ifdef ESP8266
+// The size of the RTC user memory (bytes)
+static const size_t RTC_MEMORY_SIZE = 512;
+#else
+static const size_t RTC_MEMORY_SIZE = QTH_RTC_STORAGE_SIZE;
+#endif
+
+Qth::RTCStorage::RTCStorage(size_t offset, size_t size) :
+	offset(offset),
+	size(offset >= RTC_MEMORY_SIZE ? 0 :
+	     size < RTC_MEMORY_SIZE - offset ? size : RTC_MEMORY_SIZE - offset)
+#ifdef ESP8266
+	, image(NULL)
+#endif
+{
+}
+
+#ifdef ESP8266
+
+Qth::RTCStorage::~RTCStorage() {
+	commit();
+	Qth::deallocate(image);
+}
+
+void Qth::RTCStorage::loadImage() {
+	if (image) {
+		return;
+	}
+	
+	// NB: RTC memory is accessed in whole 32-bit words
+	size_t imageSize = (size + 3) & ~(size_t)3;
+	image = (uint32_t *)Qth::allocate(imageSize);
+	if (!image) {
+		return;
+	}
+	ESP.rtcUserMemoryRead(offset / 4, image, imageSize);
+}
+
+const char *Qth::RTCStorage::getDataPtr(size_t address) {
+	loadImage();
+	return image ? (const char *)image + address : NULL;
+}
+
+void Qth::RTCStorage::readBytes(size_t address, char *buf, size_t length) {
+	loadImage();
+	if (image) {
+		memcpy(buf, (const char *)image + address, length);
+	} else {
+		memset(buf, 0, length);
+	}
+}
+
+void Qth::RTCStorage::writeBytes(size_t address, const char *buf, size_t length) {
+	loadImage();
+	if (image) {
+		memcpy((char *)image + address, buf, length);
+	}
+}
+
+void Qth::RTCStorage::commitBytes() {
+	if (image) {
+		size_t imageSize = (size + 3) & ~(size_t)3;
+		ESP.rtcUserMemoryWrite(offset / 4, image, imageSize);
+	}
+}
+
+#else
+
+// On the ESP32 RTC slow memory is directly addressable so no RAM copy is
+// required.
+// NB: Shared by all instances, each using the region starting at its offset
+static RTC_DATA_ATTR char rtcData[QTH_RTC_STORAGE_SIZE];
+
+Qth::RTCStorage::~RTCStorage() {
+}
+
+const char *Qth::RTCStorage::getDataPtr(size_t address) {
+	return size ? rtcData + offset + address : NULL;
+}
+
+void Qth::RTCStorage::readBytes(size_t address, char *buf, size_t length) {
+	memcpy(buf, rtcData + offset + address, length);
+}
+
+void Qth::RTCStorage::writeBytes(size_t address, const char *buf, size_t length) {
+	memcpy(rtcData + offset + address, buf, length);
+}
+
+void Qth::RTCStorage::commitBytes() {
+}
+
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#include "Qth.h"
+
+Qth::Storage *Qth::Storage::storages = NULL;
+
+Qth::Storage::Storage() :
+	nextStorage(storages),
+	dirty(false)
+{
+	storages = this;
+	
+	// NB: Hooked in here so that sketches without storage don't include it
+	Qth::QthClient::commitStorage = commitAll;
+}
+
+Qth::Storage::~Storage() {
+	// Remove from list
+	Qth::Storage **storagePtr = &storages;
+	while (*storagePtr) {
+		if ((*storagePtr) == this) {
+			*storagePtr = nextStorage;
+		} else {
+			storagePtr = &((*storagePtr)->nextStorage);
+		}
+	}
+}
+
+void Qth::Storage::commitAll() {
+	Qth::Storage *storage = storages;
+	while (storage) {
+		storage->commit();
+		storage = storage->nextStorage;
+	}
+}
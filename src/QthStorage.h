@@ -0,0 +1,295 @@
+#ifndef QTH_STORAGE_H
+#define QTH_STORAGE_H
+
+#include <Arduino.h>
+
+#if defined(ESP8266) || defined(ESP32)
+#include <FS.h>
+#endif
+
+// EEPROMStorage (and EEPROMProperty) are only available when the Arduino
+// 'EEPROM' library is
+#if defined(__has_include)
+#if __has_include(<EEPROM.h>)
+#define QTH_HAS_EEPROM
+#endif
+#else
+#define QTH_HAS_EEPROM
+#endif
+
+namespace Qth {
+	
+	/**
+	 * A persistent storage backend for PersistentProperty values.
+	 *
+	 * A Storage presents a flat, byte-addressed block of non-volatile memory.
+	 * Writes are made to a RAM copy and only made persistent when commit() is
+	 * called. As a result many properties changing at once cost only a single
+	 * (e.g. flash) write. QthClient::loop() commits all storages with pending
+	 * writes at the end of every cycle so you don't normally need to call
+	 * commit() yourself.
+	 *
+	 * Implement a new backend by overriding getSize(), readBytes(),
+	 * writeBytes() and commitBytes() (and optionally getDataPtr()). Accesses
+	 * are limited to the storage's size before being passed to the backend.
+	 */
+	class Storage {
+		private:
+			// Linked list of all Storage instances (for commitAll()).
+			static Storage *storages;
+			Storage *nextStorage;
+			
+			bool dirty;
+		
+		protected:
+			/**
+			 * Copy 'length' bytes starting at 'address' into 'buf'. (The bytes
+			 * accessed by this and writeBytes() always lie within getSize() and
+			 * 'length' is never zero.)
+			 */
+			virtual void readBytes(size_t address, char *buf, size_t length) = 0;
+			
+			/**
+			 * Copy 'length' bytes from 'buf' into the (RAM copy of the) storage
+			 * starting at 'address'. This need not be persistent until commitBytes
+			 * is called.
+			 */
+			virtual void writeBytes(size_t address, const char *buf, size_t length) = 0;
+			
+			/**
+			 * Make all writes since the last call persistent.
+			 */
+			virtual void commitBytes() = 0;
+		
+		public:
+			Storage();
+			virtual ~Storage();
+			
+			/**
+			 * Get the number of bytes of storage available.
+			 */
+			virtual size_t getSize() = 0;
+			
+			/**
+			 * Get a pointer to the stored data at the given address, if the
+			 * backend keeps a RAM copy of its contents, or NULL otherwise. At most
+			 * clampLength(address, ...) bytes may be read from the pointer. The
+			 * pointer is invalidated by any call to write().
+			 */
+			virtual const char *getDataPtr(size_t /* address */) {return NULL;}
+			
+			/**
+			 * Limit 'length' such that 'length' bytes starting at 'address' lie
+			 * within the storage.
+			 */
+			size_t clampLength(size_t address, size_t length) {
+				size_t size = getSize();
+				if (address >= size) {
+					return 0;
+				}
+				return length < size - address ? length : size - address;
+			}
+			
+			/**
+			 * Read 'length' bytes starting at 'address' into 'buf'. Bytes beyond
+			 * the end of the storage read as zero.
+			 */
+			void read(size_t address, char *buf, size_t length) {
+				size_t available = clampLength(address, length);
+				if (available) {
+					readBytes(address, buf, available);
+				}
+				memset(buf + available, 0, length - available);
+			}
+			
+			/**
+			 * Write 'length' bytes from 'buf' starting at 'address'. The write will
+			 * be made persistent by the next call to commit(). Bytes beyond the
+			 * end of the storage are discarded.
+			 */
+			void write(size_t address, const char *buf, size_t length) {
+				length = clampLength(address, length);
+				if (length) {
+					writeBytes(address, buf, length);
+					dirty = true;
+				}
+			}
+			
+			/**
+			 * Make all writes since the last commit persistent. Does nothing if
+			 * nothing has been written.
+			 */
+			void commit() {
+				if (dirty) {
+					commitBytes();
+					dirty = false;
+				}
+			}
+			
+			/**
+			 * Commit all Storage instances with pending writes.
+			 */
+			static void commitAll();
+	};
+	
+#ifdef QTH_HAS_EEPROM
+	/**
+	 * Storage in the Arduino 'EEPROM' library's EEPROM (the default storage
+	 * used by EEPROMProperty).
+	 *
+	 * Only available on platforms with the EEPROM library. (NB: The Arduino
+	 * IDE only makes the library available once it is included, so include
+	 * <EEPROM.h> in your sketch.)
+	 *
+	 * You must ensure the EEPROM library is ready-to-use before this storage is
+	 * accessed. In particular, on ESP8266/ESP32 platforms this means
+	 * EEPROM.begin() must have been called.
+	 */
+	class EEPROMStorage : public Storage {
+		protected:
+			virtual void readBytes(size_t address, char *buf, size_t length);
+			virtual void writeBytes(size_t address, const char *buf, size_t length);
+			virtual void commitBytes();
+		
+		public:
+			virtual size_t getSize();
+			virtual const char *getDataPtr(size_t address);
+			
+			/**
+			 * Get the (singleton) EEPROMStorage instance.
+			 */
+			static EEPROMStorage &instance();
+	};
+#endif
+
+#if defined(ESP8266) || defined(ESP32)
+	/**
+	 * Storage in a single file of a filesystem (e.g. LittleFS or SPIFFS).
+	 *
+	 * The whole file is read into RAM when first accessed and rewritten on each
+	 * commit. The filesystem must be mounted (e.g. LittleFS.begin()) before any
+	 * stored value is accessed.
+	 *
+	 * Each commit writes a temporary file ("<path>.tmp") which then replaces
+	 * the file so that a commit interrupted by power loss leaves the
+	 * previously committed values intact.
+	 */
+	class FileStorage : public Storage {
+		protected:
+			fs::FS &fs;
+			const char *path;
+			size_t size;
+			
+			// RAM copy of the file contents (NULL until first accessed)
+			char *image;
+			
+			void loadImage();
+			
+			virtual void readBytes(size_t address, char *buf, size_t length);
+			virtual void writeBytes(size_t address, const char *buf, size_t length);
+			virtual void commitBytes();
+		
+		public:
+			/**
+			 * @param fs The filesystem to use (e.g. LittleFS or SPIFFS).
+			 * @param path The path of the file to store values in. The file will
+			 *        be created if it does not exist.
+			 * @param size The number of bytes of storage required.
+			 */
+			FileStorage(fs::FS &fs, const char *path, size_t size) :
+				fs(fs),
+				path(path),
+				size(size),
+				image(NULL)
+				{};
+			
+			virtual ~FileStorage();
+			
+			virtual size_t getSize() {return size;}
+			virtual const char *getDataPtr(size_t address);
+	};
+
+#ifndef QTH_RTC_STORAGE_SIZE
+#define QTH_RTC_STORAGE_SIZE 256
+#endif
+	
+	/**
+	 * Storage in RTC memory. Values survive deep sleep but not power loss.
+	 *
+	 * On ESP8266 this uses the 512 bytes of RTC user memory. On ESP32 this
+	 * uses a QTH_RTC_STORAGE_SIZE byte block of RTC slow memory. Each
+	 * RTCStorage uses the part of that memory starting at the given offset
+	 * (i.e. storage 'address' 0 maps to that offset) so several instances
+	 * (e.g. one for session state and one for property values) may be used
+	 * as long as their regions don't overlap.
+	 *
+	 * RTC memory contents are undefined after power-on so you should validate
+	 * stored values (e.g. using the ESP.getResetReason()) before relying on
+	 * them.
+	 */
+	class RTCStorage : public Storage {
+		protected:
+			size_t offset;
+			size_t size;
+			
+#ifdef ESP8266
+			// RAM copy of the RTC memory contents (NULL until first accessed)
+			uint32_t *image;
+			
+			void loadImage();
+#endif
+			
+			virtual void readBytes(size_t address, char *buf, size_t length);
+			virtual void writeBytes(size_t address, const char *buf, size_t length);
+			virtual void commitBytes();
+		
+		public:
+			/**
+			 * @param offset Byte offset into the RTC memory (on ESP8266, must be
+			 *        a multiple of 4).
+			 * @param size The number of bytes of storage required (limited to
+			 *        the RTC memory remaining after 'offset').
+			 */
+			RTCStorage(size_t offset=0, size_t size=(size_t)-1);
+			
+			virtual ~RTCStorage();
+			
+			virtual size_t getSize() {return size;}
+			virtual const char *getDataPtr(size_t address);
+	};
+#endif
+
+#ifndef ARDUINO
+	/**
+	 * Storage in a memory-mapped file (for use when testing on a POSIX host).
+	 *
+	 * Writes are made directly into the mapping and commit() blocks until they
+	 * have been written to disk.
+	 */
+	class MmapStorage : public Storage {
+		protected:
+			int fd;
+			size_t size;
+			char *data;
+			
+			virtual void readBytes(size_t address, char *buf, size_t length);
+			virtual void writeBytes(size_t address, const char *buf, size_t length);
+			virtual void commitBytes();
+		
+		public:
+			/**
+			 * @param path The path of the file to store values in. The file will
+			 *        be created (and zero-filled) if it does not exist.
+			 * @param size The number of bytes of storage required.
+			 */
+			MmapStorage(const char *path, size_t size);
+			
+			virtual ~MmapStorage();
+			
+			virtual size_t getSize() {return data ? size : 0;}
+			virtual const char *getDataPtr(size_t address);
+	};
+#endif
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include "Qth.h"
+
+char *Qth::StoredProperty::beginSet(size_t length) {
+#ifdef QTH_THREADSAFE
+	// Mark the value as being modified (see get(char *, size_t))
+	sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+	               std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	
+	if (capacity < length + 1) {
+		// Other tasks may still be reading the old buffer so it is retired (and
+		// freed in the destructor) rather than freed. Buffers at least double in
+		// size each time so few buffers are ever retired.
+		size_t newCapacity = capacity * 2;
+		if (newCapacity < length + 1) {
+			newCapacity = length + 1;
+		}
+		// NB: Each buffer is prefixed with a pointer to the previous buffer
+		char *block = (char *)Qth::allocate(sizeof(char *) + newCapacity);
+		if (!block) {
+			value.store(NULL, std::memory_order_relaxed);
+			return NULL;
+		}
+		*(char **)block = buffer ? buffer - sizeof(char *) : NULL;
+		buffer = block + sizeof(char *);
+		capacity = newCapacity;
+	}
+	// NB: Released so that readers see the (possibly new) buffer allocated
+	value.store(buffer, std::memory_order_release);
+	return buffer;
+#else
+	Qth::deallocate(value);
+	value = (char *)Qth::allocate(length + 1);
+	return value;
+#endif
+}
+
+void Qth::StoredProperty::copyValue(char *dst, const char *src, size_t length) {
+#ifdef QTH_THREADSAFE
+	// NB: A seqlock reader may copy the bytes while they are being written
+	// (discarding the result) so both sides access them atomically. Relaxed
+	// ordering suffices since the sequence counter orders the accesses.
+	for (size_t i = 0; i < length; i++) {
+		__atomic_store_n(dst + i, src[i], __ATOMIC_RELAXED);
+	}
+#else
+	memcpy(dst, src, length);
+#endif
+}
+
+void Qth::StoredProperty::endSet() {
+#ifdef QTH_THREADSAFE
+	sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+	               std::memory_order_release);
+#endif
+}
+
+void Qth::StoredProperty::_set(const char *newValue) {
+	// NB: Setting the property to its current value is a no-op (and the value
+	// must not be freed before being copied!)
+	if (newValue == value) {
+		return;
+	}
+	
+	if (newValue) {
+		size_t len = strlen(newValue);
+		char *buf = beginSet(len);
+		if (buf) {
+			copyValue(buf, newValue, len + 1);
+		}
+		endSet();
+	} else {
+#ifdef QTH_THREADSAFE
+		beginSet(0);
+		value.store(NULL, std::memory_order_relaxed);
+		endSet();
+#else
+		Qth::deallocate(value);
+		value = NULL;
+#endif
+	}
+}
+
+Qth::StoredProperty::~StoredProperty() {
+#ifdef QTH_THREADSAFE
+	// Free current and retired buffers
+	char *block = buffer ? buffer - sizeof(char *) : NULL;
+	while (block) {
+		char *prev = *(char **)block;
+		Qth::deallocate(block);
+		block = prev;
+	}
+#else
+	// Free storage
+	_set(NULL);
+#endif
+}
+
+void Qth::StoredProperty::set(const char *newValue) {
+#ifdef QTH_THREADSAFE
+	// Only the QthClient loop task may modify the value
+	if (qth && qth->defer(this, Qth::PublishQueue::SET_STORED_PROPERTY, newValue)) {
+		return;
+	}
+#endif
+	_set(newValue);
+	if (qth && value) {
+		qth->setProperty(this, value);
+	}
+	Property::call(name, value);
+}
+
+const char *Qth::StoredProperty::get() {
+	return value;
+}
+
+bool Qth::StoredProperty::get(char *buf, size_t length) {
+	if (length == 0) {
+		return false;
+	}
+	
+	bool hasValue;
+#ifdef QTH_THREADSAFE
+	// Retry the copy until the value is not modified during it
+	uint32_t seq;
+	do {
+		seq = sequence.load(std::memory_order_acquire);
+		if (seq & 1) {
+			continue;
+		}
+#endif
+#ifdef QTH_THREADSAFE
+		const char *current = value.load(std::memory_order_acquire);
+#else
+		const char *current = value;
+#endif
+		hasValue = current != NULL;
+		size_t i = 0;
+		if (current) {
+			while (i < length - 1) {
+#ifdef QTH_THREADSAFE
+				char c = __atomic_load_n(current + i, __ATOMIC_RELAXED);
+#else
+				char c = current[i];
+#endif
+				if (c == '\0') {
+					break;
+				}
+				buf[i++] = c;
+			}
+		}
+		buf[i] = '\0';
+#ifdef QTH_THREADSAFE
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || sequence.load(std::memory_order_relaxed) != seq);
+#endif
+	
+	return hasValue;
+}
+
+void Qth::StoredProperty::call(const char *topic, const char *json) {
+	_set(json);
+	Property::call(topic, json);
+}
+
+
+void Qth::StoredProperty::onConnect() {
+	set(value);
+	Property::onConnect();
+};
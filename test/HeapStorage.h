@@ -0,0 +1,43 @@
+#ifndef HEAP_STORAGE_H
+#define HEAP_STORAGE_H
+
+#include <assert.h>
+
+#include "QthStorage.h"
+
+/**
+ * A Storage held in an exactly-sized heap block (so that out-of-bounds
+ * accesses are caught by AddressSanitizer).
+ */
+class HeapStorage : public Qth::Storage {
+	public:
+		char *data;
+		size_t size;
+		bool ramCopy;
+		unsigned long commits;
+		
+		HeapStorage(size_t size, bool ramCopy=false) :
+			data((char *)calloc(size, 1)),
+			size(size),
+			ramCopy(ramCopy),
+			commits(0)
+			{};
+		
+		virtual ~HeapStorage() {free(data);}
+		
+		virtual size_t getSize() {return size;}
+		virtual const char *getDataPtr(size_t address) {return ramCopy ? data + address : NULL;}
+	
+	protected:
+		virtual void readBytes(size_t address, char *buf, size_t length) {
+			assert(address + length <= size);
+			memcpy(buf, data + address, length);
+		}
+		virtual void writeBytes(size_t address, const char *buf, size_t length) {
+			assert(address + length <= size);
+			memcpy(data + address, buf, length);
+		}
+		virtual void commitBytes() {commits++;}
+};
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * Boot-time cost of 20 persisted properties: the storage traffic and host
+ * CPU time taken to construct them, load their values (on first use) and
+ * connect to Qth.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "Qth.h"
+#include "Stubs.h"
+
+static const size_t NUM_PROPERTIES = 20;
+static const size_t MAX_LENGTH = 32;
+static const int BOOTS = 1000;
+
+static char names[NUM_PROPERTIES][16];
+
+static double elapsedUs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+// Write initial values for every property into storage
+static void fill(Qth::Storage &storage) {
+	for (size_t i = 0; i < NUM_PROPERTIES; i++) {
+		char value[MAX_LENGTH];
+		snprintf(value, sizeof(value), "\"value %u\"", (unsigned)i);
+		storage.write(i * MAX_LENGTH, value, strlen(value) + 1);
+	}
+	storage.commit();
+}
+
+static void boot(const char *description, Qth::Storage &storage) {
+	Stubs::CountingClient client;
+	Qth::PersistentProperty *properties[NUM_PROPERTIES];
+	
+	double constructUs = 0;
+	double loadUs = 0;
+	double connectUs = 0;
+	
+	unsigned long eepromReads = EEPROM.reads;
+	unsigned long eepromWrites = EEPROM.writes;
+	unsigned long publishes = 0;
+	
+	for (int n = 0; n < BOOTS; n++) {
+		Stubs::log.clear();
+		Qth::QthClient qth("server", client, "boot");
+		
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < NUM_PROPERTIES; i++) {
+			properties[i] = new Qth::PersistentProperty(names[i], storage, MAX_LENGTH,
+			                                            i * MAX_LENGTH);
+		}
+		constructUs += elapsedUs(start);
+		
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < NUM_PROPERTIES; i++) {
+			properties[i]->get();
+		}
+		loadUs += elapsedUs(start);
+		
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < NUM_PROPERTIES; i++) {
+			qth.registerProperty(properties[i]);
+		}
+		qth.loop();
+		connectUs += elapsedUs(start);
+		publishes += Stubs::log.size();
+		
+		for (size_t i = 0; i < NUM_PROPERTIES; i++) {
+			delete properties[i];
+		}
+		client.stop();
+	}
+	
+	printf("%-16s %10.2f %10.2f %12.2f %12lu %12lu %10lu\n",
+	       description,
+	       constructUs / BOOTS, loadUs / BOOTS, connectUs / BOOTS,
+	       (EEPROM.reads - eepromReads) / BOOTS,
+	       (EEPROM.writes - eepromWrites) / BOOTS,
+	       publishes / BOOTS);
+}
+
+int main() {
+	Stubs::reset();
+	for (size_t i = 0; i < NUM_PROPERTIES; i++) {
+		snprintf(names[i], sizeof(names[i]), "boot/%u", (unsigned)i);
+	}
+	
+	printf("Boot with %u persisted properties of up to %u bytes (mean of %d boots)\n",
+	       (unsigned)NUM_PROPERTIES, (unsigned)MAX_LENGTH, BOOTS);
+	printf("%-16s %10s %10s %12s %12s %12s %10s\n",
+	       "storage", "new (us)", "load (us)", "connect (us)",
+	       "EEPROM reads", "EEPROM writes", "MQTT calls");
+	
+	// Byte-addressed storage without a RAM copy (e.g. AVR EEPROM)
+	Qth::EEPROMStorage &eeprom = Qth::EEPROMStorage::instance();
+	fill(eeprom);
+	boot("EEPROMStorage", eeprom);
+	
+	// Storage with a RAM copy (e.g. ESP8266 EEPROM or FileStorage)
+	Qth::MmapStorage mmap("build/bench_boot.bin", NUM_PROPERTIES * MAX_LENGTH);
+	fill(mmap);
+	boot("MmapStorage", mmap);
+	
+	return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * Network writes made by QthClient with and without a BufferedClient: the
+ * burst sent by onConnect() and a loop() which sets several properties.
+ *
+ * NB: The PubSubClient stand-in writes each packet in a single write (like
+ * PubSubClient 2.8) so the savings shown come from coalescing packets.
+ */
+
+#include <stdio.h>
+
+#include "Qth.h"
+#include "Stubs.h"
+
+static char names[64][16];
+
+struct Result {
+	unsigned long writes;
+	unsigned long segments;
+	unsigned long bytes;
+};
+
+static void run(size_t numEntities, bool buffered) {
+	Stubs::CountingClient network;
+	Qth::BufferedClient bufferedClient(network);
+	Qth::QthClient *qth = buffered
+		? new Qth::QthClient("server", bufferedClient, "node")
+		: new Qth::QthClient("server", network, "node");
+	
+	// Registered stored properties (sent on connection) and watched
+	// properties (subscribed to on connection)
+	Qth::StoredProperty *stored[64];
+	Qth::Property *watched[64];
+	for (size_t i = 0; i < numEntities; i++) {
+		stored[i] = new Qth::StoredProperty(names[i], "0", "A property.");
+		qth->registerProperty(stored[i]);
+		watched[i] = new Qth::Property(names[i] + 5, (Qth::callback_t)NULL);
+		qth->watchProperty(watched[i]);
+	}
+	
+	Result connect;
+	network.resetStats();
+	bufferedClient.resetStats();
+	qth->loop();
+	connect.writes = buffered ? bufferedClient.getWrites() : network.writes;
+	connect.segments = network.writes;
+	connect.bytes = network.bytes;
+	
+	// A loop which changes a few values
+	Result update;
+	network.resetStats();
+	bufferedClient.resetStats();
+	for (size_t i = 0; i < 3 && i < numEntities; i++) {
+		stored[i]->set("1");
+	}
+	qth->loop();
+	update.writes = buffered ? bufferedClient.getWrites() : network.writes;
+	update.segments = network.writes;
+	update.bytes = network.bytes;
+	
+	printf("%4u  %-10s %8lu %9lu %7lu   %8lu %9lu %7lu\n",
+	       (unsigned)numEntities, buffered ? "buffered" : "direct",
+	       connect.writes, connect.segments, connect.bytes,
+	       update.writes, update.segments, update.bytes);
+	
+	delete qth;
+	for (size_t i = 0; i < numEntities; i++) {
+		delete stored[i];
+		delete watched[i];
+	}
+}
+
+int main() {
+	Stubs::reset();
+	for (size_t i = 0; i < 64; i++) {
+		snprintf(names[i], sizeof(names[i]), "node/prop%u", (unsigned)i);
+	}
+	
+	printf("Network writes (BufferedClient size %u bytes)\n",
+	       (unsigned)QTH_BUFFERED_CLIENT_SIZE);
+	printf("%4s  %-10s %8s %9s %7s   %8s %9s %7s\n",
+	       "", "", "connect:", "", "", "update:", "", "");
+	printf("%4s  %-10s %8s %9s %7s   %8s %9s %7s\n",
+	       "N", "client", "writes", "segments", "bytes",
+	       "writes", "segments", "bytes");
+	size_t sizes[] = {4, 16, 64};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		run(sizes[i], false);
+		run(sizes[i], true);
+	}
+	
+	return 0;
+}
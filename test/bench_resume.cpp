@@ -0,0 +1,131 @@
+/**
+ * Wake-to-ready cost after deep sleep, with and without a session storage
+ * (see QthClient::setSessionStorage()).
+ *
+ * 'Ready' means connected with the values of all watched properties
+ * received (see QthClient::isSynced()). The simulated server sends each
+ * watched property's retained value as soon as it is subscribed to.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "Qth.h"
+#include "Stubs.h"
+#include "HeapStorage.h"
+
+static const int WAKES = 200;
+
+enum Scenario {
+	NO_SESSION,
+	RESUMED,
+	REGISTRATION_CHANGED,
+};
+
+struct Result {
+	unsigned long packets;
+	unsigned long bytes;
+	unsigned long received;
+	unsigned long ticks;
+	double us;
+};
+
+static char names[64][16];
+
+static Result wake(HeapStorage &rtc, size_t numEntities, Scenario scenario) {
+	Result result = {0, 0, 0, 0, 0.0};
+	
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node", "A battery powered node.");
+	if (scenario != NO_SESSION) {
+		qth.setSessionStorage(&rtc);
+	}
+	
+	Qth::Property *registered[64];
+	Qth::Property *watched[64];
+	for (size_t i = 0; i < numEntities; i++) {
+		registered[i] = new Qth::Property(names[i], "A registered property.");
+		qth.registerProperty(registered[i]);
+		watched[i] = new Qth::Property(names[i] + 5, (Qth::callback_t)NULL);
+		qth.watchProperty(watched[i]);
+	}
+	Qth::Property extra("node/extra", "A newly registered property.");
+	if (scenario == REGISTRATION_CHANGED) {
+		qth.registerProperty(&extra);
+	}
+	
+	Stubs::log.clear();
+	client.resetStats();
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t served = 0;
+	while (!(qth.connected() && qth.isSynced())) {
+		qth.loop();
+		result.ticks++;
+		
+		// Send the retained values of newly subscribed topics
+		for (; served < Stubs::log.size(); served++) {
+			if (Stubs::log[served].compare(0, 10, "SUBSCRIBE ") == 0) {
+				Stubs::deliver(Stubs::log[served].c_str() + 10, "123");
+				result.received++;
+			}
+		}
+	}
+	result.us = std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+	result.packets = client.writes;
+	result.bytes = client.bytes;
+	
+	// Back to sleep
+	qth.disconnect();
+	for (size_t i = 0; i < numEntities; i++) {
+		delete registered[i];
+		delete watched[i];
+	}
+	
+	return result;
+}
+
+static void run(size_t numEntities, Scenario scenario, const char *description) {
+	HeapStorage rtc(16);
+	
+	// Establish the session
+	wake(rtc, numEntities, RESUMED);
+	
+	Result total = {0, 0, 0, 0, 0.0};
+	for (int n = 0; n < WAKES; n++) {
+		if (scenario == REGISTRATION_CHANGED) {
+			wake(rtc, numEntities, RESUMED);
+		}
+		Result result = wake(rtc, numEntities, scenario);
+		total.packets += result.packets;
+		total.bytes += result.bytes;
+		total.received += result.received;
+		total.ticks += result.ticks;
+		total.us += result.us;
+	}
+	
+	printf("%9u  %-22s %10lu %10lu %10lu %6lu %10.2f\n",
+	       (unsigned)numEntities, description,
+	       total.packets / WAKES, total.bytes / WAKES, total.received / WAKES,
+	       total.ticks / WAKES, total.us / WAKES);
+}
+
+int main() {
+	Stubs::reset();
+	for (size_t i = 0; i < 64; i++) {
+		snprintf(names[i], sizeof(names[i]), "node/prop%u", (unsigned)i);
+	}
+	
+	printf("Wake to ready (mean of %d wakes), N registered + N watched properties\n", WAKES);
+	printf("%9s  %-22s %10s %10s %10s %6s %10s\n",
+	       "N", "scenario", "packets", "bytes up", "msgs down", "ticks", "CPU (us)");
+	size_t sizes[] = {4, 16, 64};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		run(sizes[i], NO_SESSION, "no session storage");
+		run(sizes[i], REGISTRATION_CHANGED, "registration changed");
+		run(sizes[i], RESUMED, "resumed");
+	}
+	
+	return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * Connect-to-synced cost against the number of watched properties, with
+ * values dispatched directly or through an InboundQueue (see
+ * QthClient::isSynced() and QthClient::setInboundQueue()).
+ *
+ * The simulated server sends each watched property's retained value as soon
+ * as it is subscribed to.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "Qth.h"
+#include "Stubs.h"
+
+static const int RUNS = 50;
+static const size_t MAX_WATCHED = 200;
+
+struct Result {
+	unsigned long ticks;
+	double us;
+};
+
+static char names[MAX_WATCHED][16];
+
+static unsigned long syncCalls;
+
+static void onSync(bool) {
+	syncCalls++;
+}
+
+static void onValue(const char *, const char *) {}
+
+// budget is the InboundQueue dispatch budget (0 for no queue)
+static Result connect(size_t numWatched, size_t budget) {
+	Result result = {0, 0.0};
+	
+	Stubs::log.clear();
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	Qth::InboundQueue queue(numWatched, 8, budget);
+	if (budget) {
+		qth.setInboundQueue(&queue);
+	}
+	qth.setSyncCallback(onSync);
+	
+	Qth::Property *watched[MAX_WATCHED];
+	for (size_t i = 0; i < numWatched; i++) {
+		watched[i] = new Qth::Property(names[i], onValue);
+		qth.watchProperty(watched[i]);
+	}
+	
+	syncCalls = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t served = 0;
+	while (!qth.isSynced()) {
+		qth.loop();
+		result.ticks++;
+		
+		// Send the retained values of newly subscribed topics
+		for (; served < Stubs::log.size(); served++) {
+			if (Stubs::log[served].compare(0, 10, "SUBSCRIBE ") == 0) {
+				Stubs::deliver(Stubs::log[served].c_str() + 10, "123");
+			}
+		}
+	}
+	result.us = std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+	assert(syncCalls == 1);
+	
+	qth.disconnect();
+	for (size_t i = 0; i < numWatched; i++) {
+		delete watched[i];
+	}
+	
+	return result;
+}
+
+static void run(size_t numWatched, size_t budget) {
+	Result total = {0, 0.0};
+	for (int n = 0; n < RUNS; n++) {
+		Result result = connect(numWatched, budget);
+		total.ticks += result.ticks;
+		total.us += result.us;
+	}
+	
+	char description[32];
+	if (budget) {
+		snprintf(description, sizeof(description), "queued, budget %u", (unsigned)budget);
+	} else {
+		snprintf(description, sizeof(description), "direct");
+	}
+	printf("%9u  %-18s %6lu %10.2f\n",
+	       (unsigned)numWatched, description,
+	       total.ticks / RUNS, total.us / RUNS);
+}
+
+int main() {
+	Stubs::reset();
+	for (size_t i = 0; i < MAX_WATCHED; i++) {
+		snprintf(names[i], sizeof(names[i]), "other/prop%u", (unsigned)i);
+	}
+	
+	printf("Connect to synced (mean of %d connects), N watched properties\n", RUNS);
+	printf("%9s  %-18s %6s %10s\n", "N", "dispatch", "ticks", "CPU (us)");
+	size_t sizes[] = {1, 10, 50, 200};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		run(sizes[i], 0);
+		run(sizes[i], 4);
+		run(sizes[i], 16);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal host (non-Arduino) stand-in for the Arduino core. NB: ARDUINO is
+// deliberately not defined so that host-only code (e.g. MmapStorage) is
+// built.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/**
+ * Returns Stubs::now (see Stubs.h).
+ */
+unsigned long millis();
+
+#endif
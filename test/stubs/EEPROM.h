@@ -0,0 +1,29 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <Arduino.h>
+
+#ifndef STUB_EEPROM_SIZE
+#define STUB_EEPROM_SIZE 4096
+#endif
+
+/**
+ * An AVR-style EEPROM (i.e. written immediately, no RAM copy) held in RAM.
+ */
+class EEPROMClass {
+	public:
+		uint8_t data[STUB_EEPROM_SIZE];
+		
+		// Number of bytes read and actually changed
+		unsigned long reads;
+		unsigned long writes;
+		
+		uint8_t read(int address);
+		void write(int address, uint8_t value);
+		void update(int address, uint8_t value);
+		uint16_t length() {return STUB_EEPROM_SIZE;}
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
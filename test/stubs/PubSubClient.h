@@ -0,0 +1,58 @@
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 512
+#endif
+
+// NB: Like the real PubSubClient on non-ESP platforms (e.g. AVR) a plain
+// function pointer is used for callbacks.
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char *, uint8_t *, unsigned int)
+
+namespace Stubs {
+	void deliver(const char *topic, const char *payload);
+	void dropConnection();
+}
+
+/**
+ * A stand-in for PubSubClient which writes real MQTT packets to the network
+ * Client (one write per packet, like PubSubClient 2.8) but never reads any:
+ * the server is assumed to accept everything. Every call is also recorded in
+ * Stubs::log and messages are injected using Stubs::deliver() (see Stubs.h).
+ *
+ * NB: Unlike PubSubClient, packets larger than MQTT_MAX_PACKET_SIZE are sent.
+ */
+class PubSubClient {
+	private:
+		const char *domain;
+		uint16_t port;
+		MQTT_CALLBACK_SIGNATURE;
+		Client *client;
+		bool isConnected;
+		uint16_t nextMsgId;
+		
+		bool writePacket(uint8_t header, const char *body, size_t length);
+	
+	public:
+		PubSubClient(const char *domain, uint16_t port,
+		             MQTT_CALLBACK_SIGNATURE, Client &client);
+		
+		boolean connect(const char *id, const char *user, const char *pass,
+		                const char *willTopic, uint8_t willQos,
+		                boolean willRetain, const char *willMessage,
+		                boolean cleanSession);
+		void disconnect();
+		boolean publish(const char *topic, const char *payload, boolean retained);
+		boolean subscribe(const char *topic, uint8_t qos);
+		boolean unsubscribe(const char *topic);
+		boolean loop();
+		boolean connected();
+	
+	friend void Stubs::deliver(const char *topic, const char *payload);
+	friend void Stubs::dropConnection();
+};
+
+#endif
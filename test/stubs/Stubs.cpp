@@ -0,0 +1,190 @@
+#include "Stubs.h"
+
+unsigned long Stubs::now = 0;
+std::vector<std::string> Stubs::log;
+
+unsigned long millis() {
+	return Stubs::now;
+}
+
+/******************************************************************************
+ * EEPROM
+ ******************************************************************************/
+
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int address) {
+	reads++;
+	return data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+	writes++;
+	data[address] = value;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+	if (data[address] != value) {
+		write(address, value);
+	}
+}
+
+/******************************************************************************
+ * PubSubClient
+ ******************************************************************************/
+
+static PubSubClient *instance = NULL;
+
+// Append an MQTT length-prefixed string
+static void appendString(std::string &body, const char *str) {
+	size_t length = strlen(str);
+	body += (char)(length >> 8);
+	body += (char)(length & 0xFF);
+	body.append(str, length);
+}
+
+PubSubClient::PubSubClient(const char *domain, uint16_t port,
+                           MQTT_CALLBACK_SIGNATURE, Client &client) :
+	domain(domain),
+	port(port),
+	callback(callback),
+	client(&client),
+	isConnected(false),
+	nextMsgId(1)
+{
+	instance = this;
+}
+
+bool PubSubClient::writePacket(uint8_t header, const char *body, size_t length) {
+	std::string packet(1, (char)header);
+	size_t remaining = length;
+	do {
+		uint8_t digit = remaining % 128;
+		remaining /= 128;
+		packet += (char)(remaining ? (digit | 0x80) : digit);
+	} while (remaining);
+	packet.append(body, length);
+	
+	return client->write((const uint8_t *)packet.data(), packet.size()) == packet.size();
+}
+
+boolean PubSubClient::connect(const char *id, const char *, const char *,
+                              const char *willTopic, uint8_t willQos,
+                              boolean willRetain, const char *willMessage,
+                              boolean cleanSession) {
+	if (!client->connect(domain, port)) {
+		return false;
+	}
+	
+	std::string body;
+	appendString(body, "MQTT");
+	body += (char)4;  // Protocol level
+	uint8_t flags = cleanSession ? 0x02 : 0x00;
+	if (willTopic) {
+		flags |= 0x04 | (willQos << 3) | (willRetain ? 0x20 : 0x00);
+	}
+	body += (char)flags;
+	body += (char)0;  // Keep alive
+	body += (char)15;
+	appendString(body, id);
+	if (willTopic) {
+		appendString(body, willTopic);
+		appendString(body, willMessage);
+	}
+	
+	isConnected = writePacket(0x10, body.data(), body.size());
+	if (isConnected) {
+		Stubs::log.push_back(cleanSession ? "CONNECT clean" : "CONNECT resume");
+	}
+	return isConnected;
+}
+
+void PubSubClient::disconnect() {
+	writePacket(0xE0, "", 0);
+	client->stop();
+	isConnected = false;
+	Stubs::log.push_back("DISCONNECT");
+}
+
+boolean PubSubClient::publish(const char *topic, const char *payload, boolean retained) {
+	if (!connected()) {
+		return false;
+	}
+	
+	std::string body;
+	appendString(body, topic);
+	body += payload;
+	Stubs::log.push_back(std::string("PUBLISH ") + topic + " " + payload);
+	return writePacket(retained ? 0x31 : 0x30, body.data(), body.size());
+}
+
+boolean PubSubClient::subscribe(const char *topic, uint8_t qos) {
+	if (!connected()) {
+		return false;
+	}
+	
+	std::string body;
+	body += (char)(nextMsgId >> 8);
+	body += (char)(nextMsgId & 0xFF);
+	nextMsgId++;
+	appendString(body, topic);
+	body += (char)qos;
+	Stubs::log.push_back(std::string("SUBSCRIBE ") + topic);
+	return writePacket(0x82, body.data(), body.size());
+}
+
+boolean PubSubClient::unsubscribe(const char *topic) {
+	if (!connected()) {
+		return false;
+	}
+	
+	std::string body;
+	body += (char)(nextMsgId >> 8);
+	body += (char)(nextMsgId & 0xFF);
+	nextMsgId++;
+	appendString(body, topic);
+	Stubs::log.push_back(std::string("UNSUBSCRIBE ") + topic);
+	return writePacket(0xA2, body.data(), body.size());
+}
+
+boolean PubSubClient::loop() {
+	return connected();
+}
+
+boolean PubSubClient::connected() {
+	if (isConnected && !client->connected()) {
+		isConnected = false;
+	}
+	return isConnected;
+}
+
+/******************************************************************************
+ * Stub controls
+ ******************************************************************************/
+
+void Stubs::reset() {
+	now = 0;
+	log.clear();
+	memset(EEPROM.data, 0, sizeof(EEPROM.data));
+	EEPROM.reads = 0;
+	EEPROM.writes = 0;
+}
+
+void Stubs::deliver(const char *topic, const char *payload) {
+	if (instance && instance->callback) {
+		// NB: Like PubSubClient, the payload is not null-terminated (and the
+		// buffer is reused)
+		static char buffer[MQTT_MAX_PACKET_SIZE];
+		size_t length = strlen(payload);
+		memcpy(buffer, payload, length);
+		buffer[length] = '#';
+		instance->callback((char *)topic, (uint8_t *)buffer, length);
+	}
+}
+
+void Stubs::dropConnection() {
+	if (instance) {
+		instance->isConnected = false;
+		instance->client->stop();
+	}
+}
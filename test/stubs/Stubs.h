@@ -0,0 +1,78 @@
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <Client.h>
+#include <EEPROM.h>
+#include <PubSubClient.h>
+
+/**
+ * Controls for the host stand-ins of the Arduino core, EEPROM library and
+ * PubSubClient.
+ */
+namespace Stubs {
+	
+	/**
+	 * The value returned by millis().
+	 */
+	extern unsigned long now;
+	
+	/**
+	 * A record of every PubSubClient call, e.g. "CONNECT clean",
+	 * "PUBLISH <topic> <payload>", "SUBSCRIBE <topic>".
+	 */
+	extern std::vector<std::string> log;
+	
+	/**
+	 * Reset the clock, log and EEPROM (to all zeros).
+	 */
+	void reset();
+	
+	/**
+	 * Deliver a message to the (most recently constructed) PubSubClient's
+	 * callback, as if received from the server.
+	 */
+	void deliver(const char *topic, const char *payload);
+	
+	/**
+	 * Make the (most recently constructed) PubSubClient lose its connection.
+	 */
+	void dropConnection();
+	
+	/**
+	 * A network Client which discards written data, counting the write calls
+	 * (i.e. potential TCP segments) and bytes.
+	 */
+	class CountingClient : public Client {
+		public:
+			unsigned long writes;
+			unsigned long bytes;
+			bool isConnected;
+			
+			CountingClient() : writes(0), bytes(0), isConnected(false) {};
+			
+			void resetStats() {writes = 0; bytes = 0;}
+			
+			virtual int connect(IPAddress, uint16_t) {isConnected = true; return 1;}
+			virtual int connect(const char *, uint16_t) {isConnected = true; return 1;}
+			virtual size_t write(uint8_t b) {return write(&b, 1);}
+			virtual size_t write(const uint8_t *, size_t size) {
+				writes++;
+				bytes += size;
+				return size;
+			}
+			virtual int available() {return 0;}
+			virtual int read() {return -1;}
+			virtual int read(uint8_t *, size_t) {return -1;}
+			virtual int peek() {return -1;}
+			virtual void flush() {}
+			virtual void stop() {isConnected = false;}
+			virtual uint8_t connected() {return isConnected;}
+			virtual operator bool() {return isConnected;}
+	};
+}
+
+#endif
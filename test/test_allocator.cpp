@@ -0,0 +1,125 @@
+/**
+ * Tests of the allocator hooks and PoolAllocator (see Qth::setAllocator()).
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "Qth.h"
+#include "Stubs.h"
+
+// The memory budget for the client used in testBudget()
+#define BUDGET 1024
+
+static void testStats() {
+	static char arena[512];
+	Qth::PoolAllocator pool(arena, sizeof(arena));
+	size_t size = pool.getSize();
+	assert(size > 0 && size <= sizeof(arena));
+	assert(pool.getUsed() == 0);
+	assert(pool.getFragmentation() == 0);
+	
+	void *a = pool.allocate(32);
+	void *b = pool.allocate(32);
+	void *c = pool.allocate(32);
+	assert(a && b && c);
+	size_t used = pool.getUsed();
+	assert(used >= 96);
+	assert(pool.getPeak() == used);
+	
+	// A hole in the middle fragments the free space
+	pool.deallocate(b);
+	assert(pool.getUsed() < used);
+	assert(pool.getPeak() == used);
+	assert(pool.getFragmentation() > 0);
+	assert(pool.getLargestFree() < size - pool.getUsed());
+	
+	// Requests larger than the arena fail and are counted
+	assert(pool.allocate(size) == NULL);
+	assert(pool.getFailures() == 1);
+	
+	pool.deallocate(a);
+	pool.deallocate(c);
+	assert(pool.getUsed() == 0);
+	assert(pool.getFragmentation() == 0);
+	assert(pool.getLargestFree() + 16 >= size);
+	
+	// Memory from outside the arena is passed to free()
+	pool.deallocate(malloc(16));
+	assert(pool.getUsed() == 0);
+}
+
+// A client with registered, watched and queued entities stays within budget
+static void testBudget() {
+	static char arena[BUDGET * 2];
+	Qth::PoolAllocator pool(arena, sizeof(arena));
+	
+	// Allocated with malloc before the allocator is installed
+	Qth::StoredProperty *early = new Qth::StoredProperty("node/early", "1");
+	
+	assert(Qth::setAllocator(&pool));
+	{
+		Stubs::CountingClient client;
+		Qth::QthClient qth("server", client, "node", "A test node.");
+		Qth::InboundQueue queue(4, 32);
+		qth.setInboundQueue(&queue);
+		
+		static const char *names[8] = {
+			"node/p0", "node/p1", "node/p2", "node/p3",
+			"other/p4", "other/p5", "other/p6", "other/p7",
+		};
+		Qth::StoredProperty *stored[8];
+		for (int i = 0; i < 8; i++) {
+			stored[i] = new Qth::StoredProperty(names[i], i < 4 ? "0" : NULL);
+		}
+		for (int i = 0; i < 4; i++) {
+			qth.registerProperty(stored[i]);
+			qth.watchProperty(stored[i + 4]);
+		}
+		
+		for (int cycle = 0; cycle < 10; cycle++) {
+			qth.loop();
+			assert(qth.connected());
+			
+			char value[16];
+			snprintf(value, sizeof(value), "%d", cycle * 1000);
+			for (int i = 0; i < 4; i++) {
+				stored[i]->set(value);
+				Stubs::deliver(names[i + 4], value);
+			}
+			qth.loop();
+			assert(strcmp(stored[7]->get(), value) == 0);
+			
+			Stubs::dropConnection();
+			Stubs::now += Qth::RECONNECT_DELAY + 1;
+		}
+		
+		// Swapping out the allocator while it owns memory is not allowed
+		assert(!Qth::setAllocator(NULL));
+		
+		printf("peak %u of %u bytes, %u%% fragmented, %u bytes largest free\n",
+		       (unsigned)pool.getPeak(), (unsigned)BUDGET,
+		       pool.getFragmentation(), (unsigned)pool.getLargestFree());
+		assert(pool.getPeak() <= BUDGET);
+		assert(pool.getFailures() == 0);
+		
+		for (int i = 0; i < 8; i++) {
+			delete stored[i];
+		}
+	}
+	
+	// Everything allocated from the arena has been returned
+	assert(pool.getUsed() == 0);
+	delete early;
+	assert(pool.getUsed() == 0);
+	
+	assert(Qth::setAllocator(NULL));
+}
+
+int main() {
+	Stubs::reset();
+	testStats();
+	testBudget();
+	printf("OK\n");
+	return 0;
+}
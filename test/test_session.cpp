@@ -0,0 +1,133 @@
+/**
+ * Tests of session resumption (see QthClient::setSessionStorage()).
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+
+#include "Qth.h"
+#include "Stubs.h"
+#include "HeapStorage.h"
+
+static size_t count(const char *prefix) {
+	size_t n = 0;
+	for (size_t i = 0; i < Stubs::log.size(); i++) {
+		if (Stubs::log[i].compare(0, strlen(prefix), prefix) == 0) {
+			n++;
+		}
+	}
+	return n;
+}
+
+static bool logged(const std::string &entry) {
+	return std::find(Stubs::log.begin(), Stubs::log.end(), entry) != Stubs::log.end();
+}
+
+// Simulate waking from deep sleep: a new client with the same entities
+static void wake(HeapStorage &rtc, HeapStorage &flash, bool extraProperty,
+                 bool extraWatch=false) {
+	Stubs::log.clear();
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	qth.setSessionStorage(&rtc);
+	
+	Qth::Property registered("node/registered", "Registered.");
+	Qth::Property extra("node/extra", "Extra.");
+	Qth::Property watched("other/watched", (Qth::callback_t)NULL);
+	Qth::Property extraWatched("other/extra", (Qth::callback_t)NULL);
+	Qth::PersistentProperty persisted("node/persisted", flash, 16);
+	
+	qth.registerProperty(&registered);
+	if (extraProperty) {
+		qth.registerProperty(&extra);
+	}
+	qth.watchProperty(&watched);
+	if (extraWatch) {
+		qth.watchProperty(&extraWatched);
+	}
+	
+	qth.loop();
+	assert(qth.connected());
+	
+	// Set a (new) value then immediately go back to sleep (without another
+	// loop())
+	static unsigned int wakes = 0;
+	char value[16];
+	snprintf(value, sizeof(value), "\"sleepy %u\"", ++wakes);
+	persisted.set(value);
+	unsigned long commits = flash.commits;
+	qth.disconnect();
+	assert(flash.commits == commits + 1);
+	assert(strcmp(flash.data, value) == 0);
+}
+
+// Values set after the connection is lost are still committed by disconnect()
+static void testDisconnectOffline() {
+	HeapStorage flash(16);
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	Qth::PersistentProperty persisted("node/persisted", flash, 16);
+	qth.loop();
+	assert(qth.connected());
+	
+	Stubs::dropConnection();
+	persisted.set("\"offline\"");
+	Stubs::log.clear();
+	qth.disconnect();
+	assert(flash.commits == 1);
+	assert(strcmp(flash.data, "\"offline\"") == 0);
+	assert(!logged("DISCONNECT"));
+}
+
+int main() {
+	Stubs::reset();
+	HeapStorage rtc(16);
+	HeapStorage flash(16);
+	
+	// First boot: nothing to resume
+	wake(rtc, flash, false);
+	assert(logged("CONNECT resume"));
+	assert(count("PUBLISH meta/clients/node ") == 1);
+	assert(count("SUBSCRIBE ") == 1);
+	
+	// Unchanged: registration and subscriptions skipped
+	wake(rtc, flash, false);
+	assert(count("PUBLISH meta/clients/node ") == 0);
+	assert(count("SUBSCRIBE ") == 0);
+	
+	// Registration changed: only the registration is re-sent
+	wake(rtc, flash, true);
+	assert(count("PUBLISH meta/clients/node ") == 1);
+	assert(count("SUBSCRIBE ") == 0);
+	
+	// Unclean end of session (e.g. power loss): everything re-sent
+	memset(rtc.data, 0, rtc.size);
+	wake(rtc, flash, true);
+	assert(count("PUBLISH meta/clients/node ") == 1);
+	assert(count("SUBSCRIBE ") == 1);
+	
+	// Subscriptions changed: the old session (and its stale subscriptions)
+	// is discarded with a clean session...
+	wake(rtc, flash, true);
+	wake(rtc, flash, true, true);
+	assert(logged("CONNECT clean"));
+	assert(count("SUBSCRIBE ") == 2);
+	
+	// ...which can't be resumed so a new persistent session is started...
+	wake(rtc, flash, true, true);
+	assert(logged("CONNECT resume"));
+	assert(count("SUBSCRIBE ") == 2);
+	
+	// ...and resumed
+	wake(rtc, flash, true, true);
+	assert(logged("CONNECT resume"));
+	assert(count("SUBSCRIBE ") == 0);
+	assert(count("PUBLISH meta/clients/node ") == 0);
+	
+	testDisconnectOffline();
+	
+	printf("OK\n");
+	return 0;
+}
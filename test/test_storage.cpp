@@ -0,0 +1,137 @@
+/**
+ * Tests of Storage and PersistentProperty.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+#include "Qth.h"
+#include "Stubs.h"
+#include "HeapStorage.h"
+
+static void testClamping() {
+	HeapStorage storage(8, false);
+	
+	assert(storage.clampLength(0, 4) == 4);
+	assert(storage.clampLength(6, 4) == 2);
+	assert(storage.clampLength(8, 4) == 0);
+	assert(storage.clampLength(100, 4) == 0);
+	
+	// Writes beyond the end are discarded
+	storage.write(4, "abcdefgh", 8);
+	assert(memcmp(storage.data + 4, "abcd", 4) == 0);
+	storage.write(8, "x", 1);
+	storage.commit();
+	assert(storage.commits == 1);
+	
+	// Writing nothing leaves the storage clean
+	storage.write(100, "x", 1);
+	storage.commit();
+	assert(storage.commits == 1);
+	
+	// Reads beyond the end are zero
+	char buf[8];
+	memset(buf, 'z', sizeof(buf));
+	storage.read(6, buf, sizeof(buf));
+	assert(memcmp(buf, "cd\0\0\0\0\0\0", 8) == 0);
+}
+
+// A persistent property with a maximum length larger than its storage
+static void testOversizedProperty(bool ramCopy) {
+	HeapStorage storage(16, ramCopy);
+	
+	std::string longValue(100, 'x');
+	{
+		Qth::PersistentProperty property("test/property", storage, 512, 4);
+		property.set(longValue.c_str());
+		assert(property.get() == longValue);
+		storage.commit();
+	}
+	
+	// Only the part of the value which fits is stored (unterminated)
+	assert(memcmp(storage.data + 4, longValue.c_str(), 12) == 0);
+	
+	Qth::PersistentProperty property("test/property", storage, 512, 4);
+	assert(std::string(property.get()) == longValue.substr(0, 12));
+	
+	// Entirely beyond the end of the storage
+	Qth::PersistentProperty outside("test/outside", storage, 512, 32);
+	assert(strcmp(outside.get(), "") == 0);
+	outside.set("\"hello\"");
+	assert(strcmp(outside.get(), "\"hello\"") == 0);
+}
+
+// Values round-trip through storage without being written back on load
+static void testLoad(bool ramCopy) {
+	HeapStorage storage(64, ramCopy);
+	storage.write(8, "\"stored\"", 9);
+	storage.commit();
+	
+	Qth::PersistentProperty property("test/property", storage, 16, 8);
+	assert(strcmp(property.get(), "\"stored\"") == 0);
+	Qth::Storage::commitAll();
+	assert(storage.commits == 1);
+	
+	// Truncated to maxLength - 1 when unterminated
+	storage.write(32, "0123456789", 10);
+	Qth::PersistentProperty truncated("test/truncated", storage, 4, 32);
+	assert(strcmp(truncated.get(), "012") == 0);
+}
+
+// The value loaded without a RAM copy occupies only its own length
+static void testLoadSize() {
+	static char arena[1024];
+	Qth::PoolAllocator pool(arena, sizeof(arena));
+	HeapStorage storage(600, false);
+	storage.write(0, "ab", 3);
+	
+	assert(Qth::setAllocator(&pool));
+	{
+		Qth::PersistentProperty property("test/property", storage, 512, 0);
+		assert(strcmp(property.get(), "ab") == 0);
+		assert(pool.getUsed() <= 32);
+		assert(pool.getFailures() == 0);
+	}
+	assert(Qth::setAllocator(NULL));
+}
+
+// A watched (but not registered) property isn't re-written by the value the
+// server sends on connection when it matches the stored one
+static void testWatchedUnchanged() {
+	HeapStorage storage(16);
+	storage.write(0, "\"same\"", 7);
+	storage.commit();
+	
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	Qth::PersistentProperty property("other/property", storage, 16, 0);
+	qth.watchProperty(&property);
+	qth.loop();
+	
+	Stubs::deliver("other/property", "\"same\"");
+	qth.loop();
+	assert(storage.commits == 1);
+	assert(strcmp(property.get(), "\"same\"") == 0);
+	
+	// Changed values are still persisted
+	Stubs::deliver("other/property", "\"new\"");
+	qth.loop();
+	assert(storage.commits == 2);
+	assert(strcmp(storage.data, "\"new\"") == 0);
+}
+
+int main() {
+	Stubs::reset();
+	
+	testClamping();
+	testOversizedProperty(false);
+	testOversizedProperty(true);
+	testLoad(false);
+	testLoad(true);
+	testLoadSize();
+	testWatchedUnchanged();
+	
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * Tests of initial-state sync tracking (see QthClient::isSynced()).
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Qth.h"
+#include "Stubs.h"
+#include "HeapStorage.h"
+
+static unsigned int syncCalls;
+static bool lastTimedOut;
+
+static void onSync(bool timedOut) {
+	syncCalls++;
+	lastTimedOut = timedOut;
+}
+
+// Every value passed to onValue()
+static std::vector<std::string> received;
+
+static void onValue(const char *topic, const char *json) {
+	received.push_back(std::string(topic) + "=" + json);
+}
+
+static void reconnect(Qth::QthClient &qth) {
+	Stubs::dropConnection();
+	Stubs::now += Qth::RECONNECT_DELAY + 1;
+	qth.loop();
+	assert(qth.connected());
+}
+
+static void testInitialSync() {
+	Stubs::reset();
+	syncCalls = 0;
+	
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	qth.setSyncCallback(onSync);
+	qth.setSyncTimeout(100);
+	
+	Qth::StoredProperty a("a");
+	Qth::Property b("b", onValue);
+	Qth::Event e("e", onValue);
+	qth.watchProperty(&a);
+	qth.watchProperty(&b);
+	qth.watchEvent(&e);
+	
+	qth.loop();
+	assert(!qth.isSynced() && syncCalls == 0);
+	
+	// Events and repeated values don't complete the sync
+	Stubs::deliver("e", "1");
+	assert(!qth.isSynced());
+	Stubs::deliver("a", "1");
+	Stubs::deliver("a", "2");
+	assert(!qth.isSynced());
+	Stubs::deliver("b", "1");
+	assert(qth.isSynced() && syncCalls == 1 && !lastTimedOut);
+	
+	// A newly watched property is waited for (until the timeout)
+	Qth::Property d("d", onValue);
+	qth.watchProperty(&d);
+	assert(!qth.isSynced());
+	Stubs::now += 200;
+	qth.loop();
+	assert(qth.isSynced() && syncCalls == 2 && lastTimedOut);
+	Stubs::deliver("d", "1");
+	assert(syncCalls == 2);
+	
+	// Unwatching the only property being waited for completes the sync
+	Qth::Property f("f", onValue);
+	qth.watchProperty(&f);
+	assert(!qth.isSynced());
+	qth.unwatchProperty(&f);
+	assert(qth.isSynced() && syncCalls == 3);
+	
+	// Every value is waited for again after reconnecting
+	reconnect(qth);
+	assert(!qth.isSynced());
+	Stubs::deliver("a", "3");
+	Stubs::deliver("b", "3");
+	assert(!qth.isSynced());
+	Stubs::deliver("d", "3");
+	assert(qth.isSynced() && syncCalls == 4 && !lastTimedOut);
+}
+
+static void testUnwatchNeverWatched() {
+	Stubs::reset();
+	syncCalls = 0;
+	
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	qth.setSyncCallback(onSync);
+	
+	Qth::Property a("a", onValue);
+	Qth::Property c("c", onValue);
+	qth.watchProperty(&a);
+	qth.loop();
+	assert(!qth.isSynced());
+	
+	// Must not count as 'a' being received
+	qth.unwatchProperty(&c);
+	assert(!qth.isSynced() && syncCalls == 0);
+	
+	Stubs::deliver("a", "1");
+	assert(qth.isSynced() && syncCalls == 1);
+	
+	// ...nor leave the count wrong after reconnecting
+	qth.unwatchProperty(&c);
+	reconnect(qth);
+	assert(!qth.isSynced());
+	Stubs::deliver("a", "2");
+	assert(qth.isSynced() && syncCalls == 2);
+}
+
+static void testStaleQueue() {
+	Stubs::reset();
+	syncCalls = 0;
+	received.clear();
+	
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "node");
+	Qth::InboundQueue queue(4, 16);
+	qth.setInboundQueue(&queue);
+	qth.setSyncCallback(onSync);
+	
+	Qth::Property a("a", onValue);
+	Qth::Event e("e", onValue);
+	qth.watchProperty(&a);
+	qth.watchEvent(&e);
+	
+	qth.loop();
+	Stubs::deliver("a", "1");
+	assert(!qth.isSynced());
+	qth.loop();
+	assert(qth.isSynced() && syncCalls == 1);
+	
+	// Received but not dispatched before the connection dropped
+	Stubs::deliver("a", "stale");
+	Stubs::deliver("e", "event");
+	reconnect(qth);
+	
+	// The stale value is discarded and isn't mistaken for the current one
+	// (the event, which isn't resent by the server, is still delivered).
+	assert(!qth.isSynced());
+	assert(received.back() == "e=event");
+	for (size_t i = 0; i < received.size(); i++) {
+		assert(received[i] != "a=stale");
+	}
+	
+	Stubs::deliver("a", "2");
+	qth.loop();
+	assert(qth.isSynced() && syncCalls == 2);
+	assert(received.back() == "a=2");
+}
+
+static void testResume() {
+	Stubs::reset();
+	syncCalls = 0;
+	HeapStorage rtc(16);
+	
+	for (int wake = 0; wake < 2; wake++) {
+		Stubs::CountingClient client;
+		Qth::QthClient qth("server", client, "node");
+		qth.setSessionStorage(&rtc);
+		qth.setSyncCallback(onSync);
+		
+		Qth::Property a("a", onValue);
+		qth.watchProperty(&a);
+		qth.loop();
+		
+		if (wake == 0) {
+			// New session: wait for the retained value
+			assert(!qth.isSynced());
+			Stubs::deliver("a", "1");
+			assert(qth.isSynced() && syncCalls == 1);
+		} else {
+			// Resumed: the server won't resend retained values
+			assert(qth.isSynced() && syncCalls == 2);
+		}
+		
+		qth.disconnect();
+		assert(!qth.isSynced());
+	}
+}
+
+int main() {
+	testInitialSync();
+	testUnwatchNeverWatched();
+	testStaleQueue();
+	testResume();
+	printf("OK\n");
+	return 0;
+}
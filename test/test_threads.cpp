@@ -0,0 +1,174 @@
+/**
+ * Stress tests of threaded mode (built with QTH_THREADSAFE): the main
+ * thread plays the QthClient loop task while other threads read and set
+ * values.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "Qth.h"
+#include "Stubs.h"
+#include "HeapStorage.h"
+
+static const int ITERATIONS = 200000;
+
+// The value written by the writer for a given letter: the letter repeated
+// (1 + 2 * n) times, n being the letter's position in the alphabet.
+static std::string valueFor(char c) {
+	return std::string(1 + 2 * (c - 'a'), c);
+}
+
+// Check a value read by get(char *, size_t) is one which was written (or
+// a truncation of one)
+static void checkValue(const char *buf, size_t bufSize) {
+	size_t len = strlen(buf);
+	assert(len > 0);
+	std::string expected = valueFor(buf[0]);
+	if (expected.size() > bufSize - 1) {
+		expected.resize(bufSize - 1);
+	}
+	assert(buf == expected);
+}
+
+// Readers never block and never see torn values while the loop task
+// changes a StoredProperty
+static void testSeqlock() {
+	Qth::StoredProperty property("test/property", "\"a\"");
+	property.set("a");
+	
+	std::atomic<bool> done(false);
+	std::atomic<unsigned long> reads(0);
+	
+	std::thread reader([&]() {
+		char buf[64];
+		char small[8];
+		while (!done.load()) {
+			assert(property.get(buf, sizeof(buf)));
+			checkValue(buf, sizeof(buf));
+			assert(property.get(small, sizeof(small)));
+			checkValue(small, sizeof(small));
+			assert(!property.get(buf, 0));
+			reads += 2;
+		}
+	});
+	
+	for (int i = 0; i < ITERATIONS; i++) {
+		property.set(valueFor('a' + (i % 26)).c_str());
+	}
+	done = true;
+	reader.join();
+	
+	printf("  seqlock: %d writes, %lu reads\n", ITERATIONS, reads.load());
+	assert(reads.load() > 0);
+}
+
+// Persisted values are loaded by the loop task, never by readers
+static void testPersistentLoad() {
+	HeapStorage storage(64);
+	storage.write(0, "\"stored\"", 9);
+	
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "test");
+	Qth::PublishQueue queue(4, 32);
+	qth.setPublishQueue(&queue);
+	
+	Qth::PersistentProperty property("test/persisted", storage, 32);
+	
+	// Not loaded until the loop task runs
+	char buf[32];
+	assert(!property.get(buf, sizeof(buf)));
+	
+	std::atomic<bool> done(false);
+	std::thread reader([&]() {
+		char buf[32];
+		bool seen = false;
+		while (!done.load() || !seen) {
+			if (property.get(buf, sizeof(buf))) {
+				assert(strcmp(buf, "\"stored\"") == 0);
+				seen = true;
+			} else {
+				assert(!seen);
+				assert(strcmp(buf, "") == 0);
+			}
+		}
+	});
+	
+	qth.loop();
+	done = true;
+	reader.join();
+	
+	assert(property.get(buf, sizeof(buf)));
+	assert(strcmp(buf, "\"stored\"") == 0);
+}
+
+// Values set by another task are published, in order, by the loop task
+static void testPublishQueue() {
+	Stubs::log.clear();
+	Stubs::CountingClient client;
+	Qth::QthClient qth("server", client, "test");
+	Qth::PublishQueue queue(64, 16);
+	qth.setPublishQueue(&queue);
+	
+	Qth::Property property("test/property");
+	Qth::StoredProperty stored("test/stored");
+	qth.registerProperty(&stored);
+	qth.loop();
+	assert(qth.connected());
+	Stubs::log.clear();
+	
+	std::atomic<bool> done(false);
+	std::thread app([&]() {
+		char value[16];
+		for (int i = 0; i < ITERATIONS / 10; i++) {
+			snprintf(value, sizeof(value), "%d", i);
+			qth.setProperty(&property, value);
+			stored.set(value);
+			
+			// Give the loop task a chance to keep up (though some messages are
+			// still expected to be dropped)
+			std::this_thread::yield();
+		}
+		done = true;
+	});
+	
+	while (!done.load()) {
+		qth.loop();
+	}
+	app.join();
+	qth.loop();
+	
+	// Every message either sent (in order) or counted as dropped
+	int lastProperty = -1;
+	int lastStored = -1;
+	unsigned long sent = 0;
+	for (size_t i = 0; i < Stubs::log.size(); i++) {
+		int value;
+		if (sscanf(Stubs::log[i].c_str(), "PUBLISH test/property %d", &value) == 1) {
+			assert(value > lastProperty);
+			lastProperty = value;
+			sent++;
+		} else if (sscanf(Stubs::log[i].c_str(), "PUBLISH test/stored %d", &value) == 1) {
+			assert(value > lastStored);
+			lastStored = value;
+			sent++;
+		}
+	}
+	assert(sent + queue.getOverflows() == 2 * (ITERATIONS / 10));
+	printf("  publish queue: %lu sent, %lu dropped (queue full)\n",
+	       sent, queue.getOverflows());
+}
+
+int main() {
+	Stubs::reset();
+	
+	testSeqlock();
+	testPersistentLoad();
+	testPublishQueue();
+	
+	printf("OK\n");
+	return 0;
+}